@@ -54,6 +54,22 @@ public:
      */
     bool rayIntersect(const Ray3f &ray, Intersection &its, bool shadowRay) const;
 
+    /**
+     * \brief Report every triangle that a ray hits (any-hit traversal)
+     *
+     * Hits are reported in no particular order, and a triangle may be
+     * reported more than once.
+     *
+     * \param callback
+     *    Receives the mesh, the triangle index and the distance of each hit.
+     *    Returns \c false to stop the traversal
+     *
+     * \return \c false if the callback stopped the traversal
+     */
+    bool rayIntersectAll(const Ray3f &ray, const HitCallback &callback) const {
+        return accel_struct_->RayIntersectAll(ray, callback);
+    }
+
 private:
     BoundingBox3f m_bbox;           ///< Bounding box of the entire scene
     std::shared_ptr<AccelStruct> accel_struct_{nullptr};
@@ -5,10 +5,14 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include <nori/mesh.h>
 
 NORI_NAMESPACE_BEGIN
 
+/// Called with every triangle that a ray hits (mesh, face index, distance). Returns \c false to stop
+typedef std::function<bool(const Mesh *, uint32_t, float)> HitCallback;
+
 class AccelStruct {
  public:
   AccelStruct(const std::vector<Mesh *> &meshes);
@@ -17,6 +21,8 @@ class AccelStruct {
 							Intersection &its,
 							bool shadowRay,
 							uint32_t &face) const = 0;
+  /// Report all hits along the ray in no particular order. Returns \c false if the callback stopped the traversal
+  virtual bool RayIntersectAll(const Ray3f &ray, const HitCallback &callback) const = 0;
   virtual std::string ToString() const { return ""; }
  protected:
   virtual void Build() = 0;
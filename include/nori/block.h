@@ -125,6 +125,16 @@ public:
      *      Maximum size of the individual blocks
      */
     BlockGenerator(const Vector2i &size, int blockSize);
+
+    /**
+     * \brief Create a block generator that only covers a crop window
+     *
+     * Blocks are aligned to the same grid as in the uncropped case, but
+     * only those overlapping the window are generated, and they are
+     * clipped against it.
+     */
+    BlockGenerator(const Vector2i &size, int blockSize,
+                   const Point2i &cropOffset, const Vector2i &cropSize);
     
     /**
      * \brief Return the next block to be rendered
@@ -141,8 +151,10 @@ protected:
     enum EDirection { ERight = 0, EDown, ELeft, EUp };
 
     Point2i m_block;
+    Point2i m_firstBlock;
     Vector2i m_numBlocks;
     Vector2i m_size;
+    Point2i m_cropStart, m_cropEnd;
     int m_blockSize;
     int m_numSteps;
     int m_blocksLeft;
@@ -48,6 +48,30 @@ public:
     /// Return the size of the output image in pixels
     const Vector2i &getOutputSize() const { return m_outputSize; }
 
+    /// Return the upper left corner of the crop window (i.e. the rendered region)
+    const Point2i &getCropOffset() const { return m_cropOffset; }
+
+    /// Return the size of the crop window in pixels
+    const Vector2i &getCropSize() const { return m_cropSize; }
+
+    /**
+     * \brief Restrict rendering to a rectangular region of the image
+     *
+     * The window is clipped against the image. Pixels outside of it are
+     * not rendered, but the output keeps its full resolution.
+     */
+    void setCropWindow(const Point2i &offset, const Vector2i &size) {
+        Point2i windowEnd = offset + size;
+        Point2i start = offset.cwiseMax(Point2i(0, 0));
+        Point2i end = windowEnd.cwiseMin(Point2i(m_outputSize.x(), m_outputSize.y()));
+        if ((end.array() <= start.array()).any())
+            throw NoriException("Camera: the crop window [%s, %s] does not overlap the %ix%i image",
+                                offset.toString(), windowEnd.toString(),
+                                m_outputSize.x(), m_outputSize.y());
+        m_cropOffset = start;
+        m_cropSize = Vector2i(end.x() - start.x(), end.y() - start.y());
+    }
+
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
@@ -58,6 +82,8 @@ public:
     EClassType getClassType() const { return ECamera; }
 protected:
     Vector2i m_outputSize;
+    Point2i m_cropOffset;
+    Vector2i m_cropSize;
     ReconstructionFilter *m_rfilter;
 };
 
@@ -0,0 +1,50 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Write the accumulated film of a progressive render to disk
+ *
+ * The checkpoint stores the weighted radiance sums and filter weights of
+ * every pixel (including the border region) of \c block, along with the
+ * number of pixel samples that have been accumulated so far. The file is
+ * first written to a temporary location and then renamed, so that a
+ * crash during this function never leaves behind a truncated checkpoint.
+ *
+ * To detect incompatible renders, the checkpoint also records the sample
+ * count, the crop window of the camera and hashes of the descriptions of
+ * the sampler and of the whole scene.
+ *
+ * \param filename
+ *     Destination of the checkpoint file
+ * \param scene
+ *     The scene that is being rendered
+ * \param block
+ *     Image block holding the accumulated film
+ * \param samplesDone
+ *     Number of pixel samples that have been rendered into \c block
+ */
+extern void saveCheckpoint(const std::string &filename, const Scene *scene,
+                           const ImageBlock &block, size_t samplesDone);
+
+/**
+ * \brief Restore the accumulated film of a progressive render
+ *
+ * Throws an exception when the checkpoint does not match the resolution or
+ * reconstruction filter border of \c block, or the sample count, crop
+ * window, sampler (type and seed) or description of \c scene.
+ *
+ * \return The number of pixel samples that were already rendered
+ */
+extern size_t loadCheckpoint(const std::string &filename, const Scene *scene,
+                             ImageBlock &block);
+
+NORI_NAMESPACE_END
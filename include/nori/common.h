@@ -180,7 +180,8 @@ extern std::string memString(size_t size, bool precise = false);
 enum EMeasure {
     EUnknownMeasure = 0,
     ESolidAngle,
-    EDiscrete
+    EDiscrete,
+    EArea
 };
 
 //// Convert radians to degrees
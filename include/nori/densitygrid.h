@@ -0,0 +1,133 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/bbox.h>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Read-only view of a file that is mapped into memory
+ *
+ * The file is read through the page cache instead of being copied into a
+ * separate buffer, hence its contents are only held in memory once.
+ */
+class MemoryMappedFile {
+public:
+    /// Map the given file into memory (throws a \ref NoriException on failure)
+    MemoryMappedFile(const std::string &filename);
+
+    /// Unmap the file
+    ~MemoryMappedFile();
+
+    /// Return a pointer to the file contents
+    const void *getData() const { return m_data; }
+
+    /// Return the size of the file in bytes
+    size_t getSize() const { return m_size; }
+
+private:
+    MemoryMappedFile(const MemoryMappedFile &) = delete;
+    MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+    const void *m_data = nullptr;
+    size_t m_size = 0;
+#if defined(PLATFORM_WINDOWS)
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+/**
+ * \brief Grid of density values stored at voxel centers
+ *
+ * Two file formats are supported:
+ *
+ * - A text format, which starts with the resolution <tt>nx ny nz</tt>,
+ *   followed by <tt>nx*ny*nz</tt> whitespace-separated values (x varies
+ *   fastest). It is parsed into memory.
+ *
+ * - A binary format, which is memory-mapped, so that the values are
+ *   neither parsed from text nor copied into a second in-memory buffer. It
+ *   consists of a \ref Header followed by the values as little-endian
+ *   32-bit floats in the same order. The \c volconvert tool converts text
+ *   files to this format.
+ *
+ * Note that \c GridDensityMedium still reads every voxel while loading
+ * (to build its sparse grid and majorants).
+ */
+class DensityGrid {
+public:
+    /// Data types of the values of binary grids
+    enum EDataType : uint32_t {
+        EFloat32 = 1
+    };
+
+    /// Header of binary grid files (64 bytes)
+    struct Header {
+        /// File identifier, always <tt>"NVOL"</tt>
+        char magic[4];
+        /// Version of the format, currently 1
+        uint32_t version;
+        /// Number of voxels along each axis
+        int32_t size[3];
+        /// Type of the values (see \ref EDataType)
+        uint32_t dataType;
+        /// Minimum and maximum corner of the grid in object space
+        float bounds[6];
+        /// Largest value of the grid
+        float maxDensity;
+        uint32_t reserved[3];
+    };
+
+    /// Create an empty grid
+    DensityGrid() { }
+
+    /// Load a grid in one of the supported formats (the type is detected from the contents)
+    void load(const std::string &filename);
+
+    /// Write the grid in the binary format
+    void save(const std::string &filename) const;
+
+    /// Return the number of voxels along each axis
+    const Vector3i &getSize() const { return m_size; }
+
+    /// Return the extent of the grid in object space (the unit cube for text files)
+    const BoundingBox3f &getBounds() const { return m_bounds; }
+
+    /// Set the extent of the grid in object space
+    void setBounds(const BoundingBox3f &bounds) { m_bounds = bounds; }
+
+    /// Return the largest value of the grid
+    float getMaxDensity() const { return m_maxDensity; }
+
+    /// Return the values of all voxels (x varies fastest)
+    const float *getData() const { return m_data; }
+
+    /// Return the value of a voxel (which must lie within the grid)
+    float operator()(int x, int y, int z) const {
+        return m_data[((size_t) z * m_size.y() + y) * m_size.x() + x];
+    }
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    void loadText(const std::string &filename);
+
+    Vector3i m_size = Vector3i::Zero();
+    BoundingBox3f m_bounds = BoundingBox3f(Point3f(0.f), Point3f(1.f));
+    float m_maxDensity = 0.f;
+    const float *m_data = nullptr;
+    /// Storage of grids that were read from text files
+    std::vector<float> m_values;
+    /// Mapping of grids that were read from binary files
+    std::unique_ptr<MemoryMappedFile> m_file;
+};
+
+NORI_NAMESPACE_END
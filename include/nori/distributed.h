@@ -0,0 +1,43 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Render an image by distributing image blocks to worker processes
+ *
+ * The coordinator listens on \c address (see \ref Socket for the format)
+ * and hands out one work unit (an image block and a range of pixel
+ * samples) at a time to each connected worker. Workers stream the
+ * rendered blocks back, including their reconstruction filter border, and
+ * the coordinator merges them into \c result. Units held by a worker whose
+ * connection breaks, or which does not return its unit in time (e.g. since
+ * its host crashed), are put back into the queue and reassigned.
+ *
+ * The function returns once all units have been merged. Workers may
+ * connect and disconnect at any time while it runs.
+ *
+ * \param samplesDone
+ *     Number of pixel samples that are already contained in \c result
+ * \param passSize
+ *     Number of pixel samples per work unit
+ */
+extern void renderCoordinator(const Scene *scene, const std::string &address,
+                              ImageBlock &result, size_t samplesDone, size_t passSize);
+
+/**
+ * \brief Connect to a coordinator and render work units until it is done
+ *
+ * Each of the \c threadCount threads opens its own connection, so the
+ * coordinator sees every thread as an independent worker.
+ */
+extern void runWorker(const Scene *scene, const std::string &address, int threadCount);
+
+NORI_NAMESPACE_END
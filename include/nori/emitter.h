@@ -12,14 +12,23 @@
 NORI_NAMESPACE_BEGIN
 
 struct EmitterQueryRecord {
+    /// Illuminated reference point (needed for solid angle densities)
+    Point3f ref;
     /// Point in world space
     Point3f point;
     /// Normal in world space
     Vector3f normal;
+    /// Index of the triangle that contains \c point, if known
+    uint32_t face = (uint32_t) -1;
+    /// Measure of the density returned by \ref Emitter::pdf()
+    EMeasure measure = EArea;
 
     EmitterQueryRecord() {}
 
     EmitterQueryRecord(const Point3f &p, const Vector3f &n) : point(p), normal(n) {}
+
+    EmitterQueryRecord(const Point3f &ref, const Point3f &p, const Vector3f &n, uint32_t face)
+        : ref(ref), point(p), normal(n), face(face) {}
 };
 
 /**
@@ -35,6 +44,14 @@ public:
 
     virtual float pdf(const EmitterQueryRecord &bRec) const = 0;
 
+    /**
+     * \brief Is this an environment emitter?
+     *
+     * Environment emitters are infinitely far away and are not attached to
+     * a mesh. Their radiance is seen by rays that leave the scene.
+     */
+    virtual bool isEnvironment() const { return false; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Emitter/etc.) 
      * provided by this instance
@@ -0,0 +1,34 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Scramble the bits of a 64-bit integer
+ *
+ * This is the finalizer of the SplitMix64 generator. Nearby inputs (e.g.
+ * adjacent pixel coordinates or sample indices) map to unrelated outputs,
+ * which makes it suitable for deriving random number streams and seeds.
+ */
+inline uint64_t mixBits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+/// Hash a pair of integers (e.g. pixel coordinates)
+inline uint64_t hashCombine(uint64_t a, uint64_t b) {
+    return mixBits(a ^ mixBits(b + 0x9e3779b97f4a7c15ULL));
+}
+
+NORI_NAMESPACE_END
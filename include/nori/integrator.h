@@ -42,6 +42,60 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Accumulate \c sampleCount camera samples per pixel of an
+     * (already cleared) image block
+     *
+     * The default implementation traces every camera sample independently
+     * and calls \ref Li(). Integrators that share information between the
+     * pixels of a block can override this. The result must only depend on
+     * the block and the sampler to keep renders deterministic.
+     */
+    virtual void renderBlock(const Scene *scene, Sampler *sampler,
+                             ImageBlock &block, size_t sampleCount) const;
+
+    /**
+     * \brief Return the number of samples per pixel that \ref renderImage()
+     * should render in the next pass
+     *
+     * \param samplesDone
+     *    Number of samples per pixel that have been rendered so far
+     * \param passSize
+     *    The pass size requested by the user
+     *
+     * The default implementation returns \c passSize. Integrators that
+     * learn from previous passes can override this to use a different
+     * schedule.
+     */
+    virtual size_t getPassSize(size_t samplesDone, size_t passSize) const { return passSize; }
+
+    /**
+     * \brief Called by \ref renderImage() once a pass of \c passSamples
+     * samples per pixel has been rendered
+     *
+     * No blocks are in flight at this point, hence integrators can safely
+     * update data structures that were written to during the pass.
+     */
+    virtual void finishPass(const Scene *scene, size_t passSamples, size_t samplesDone) const { }
+
+    /**
+     * \brief Does the integrator rely on \ref getPassSize() and
+     * \ref finishPass() being called between passes?
+     *
+     * The distributed renderer hands out blocks without a notion of passes
+     * and refuses to render with such integrators.
+     */
+    virtual bool requiresPasses() const { return false; }
+
+    /**
+     * \brief Can the integrator handle meshes without a BSDF?
+     *
+     * Such meshes only bound participating media (see \ref Mesh::hasMediumInterface())
+     * and must be passed through. Scenes that contain them are rejected
+     * for all other integrators.
+     */
+    virtual bool supportsMediumBoundaries() const { return false; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
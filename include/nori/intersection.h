@@ -36,6 +36,8 @@ struct Intersection {
     Frame geoFrame;
     /// Pointer to the associated mesh
     const Mesh *mesh;
+    /// Index of the intersected triangle within the mesh
+    uint32_t face = (uint32_t) -1;
     /// medium
     MediumInterface mediumInterface;
 //    /// this if only for an interaction at a point in a scattering medium
@@ -55,8 +57,15 @@ struct Intersection {
         return shFrame.toWorld(d);
     }
 
+    /**
+     * \brief Return the medium on the side of the surface that \c w points to
+     *
+     * Uses the geometric normal (like \ref Scene::evalTransmittance()),
+     * since interpolated shading normals need not agree with the side of
+     * the triangle that a ray actually crosses
+     */
     const Medium* getMedium(const Vector3f &w) const {
-        return w.dot(shFrame.n) > 0 ? mediumInterface.m_outside :
+        return w.dot(geoFrame.n) > 0 ? mediumInterface.m_outside :
                mediumInterface.m_inside;
     }
 
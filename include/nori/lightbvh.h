@@ -0,0 +1,139 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/bbox.h>
+#include <unordered_map>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Light hierarchy for sampling scenes with many emitting triangles
+ *
+ * The hierarchy is a binary BVH over all triangles of all area emitters.
+ * Every node stores the bounding box of its triangles, a cone that bounds
+ * their normals, and their total power. Given a shading point, an upper
+ * bound of the contribution of each node can be estimated cheaply, and a
+ * triangle is chosen by descending from the root and picking one of the
+ * two children at each level proportionally to its estimate (Conty Estevez
+ * and Kulla, "Importance Sampling of Many Lights with Adaptive Tree
+ * Splitting", 2018). Triangles that face away from the shading point or
+ * that are far away are thus rarely chosen.
+ *
+ * The probability of a given triangle is found by walking from its leaf
+ * back up to the root, which is needed for multiple importance sampling.
+ */
+class LightBVH {
+public:
+    /// Create an empty hierarchy
+    LightBVH() { }
+
+    /// Build the hierarchy over all triangles of the given emitting meshes
+    void build(const std::vector<Mesh *> &emitters);
+
+    /// Release all memory
+    void clear();
+
+    /// Return the number of nodes in the hierarchy
+    size_t getNodeCount() const { return m_nodes.size(); }
+
+    /**
+     * \brief Choose an emitting triangle for the illumination of a point
+     *
+     * \param p
+     *    Position of the shading point
+     * \param n
+     *    Shading normal, or zero if the point is inside a medium
+     * \param sample
+     *    A uniformly distributed sample on <tt>[0, 1)</tt>
+     * \param mesh
+     *    Returns the mesh of the chosen triangle
+     * \param face
+     *    Returns the index of the chosen triangle within its mesh
+     * \param pmf
+     *    Returns the discrete probability of choosing the triangle
+     * \return
+     *    \c false if no triangle can contribute to the shading point
+     */
+    bool sample(const Point3f &p, const Normal3f &n, float sample,
+                const Mesh *&mesh, uint32_t &face, float &pmf) const;
+
+    /// Return the probability that \ref sample() chooses the given triangle
+    float pmf(const Point3f &p, const Normal3f &n, const Mesh *mesh, uint32_t face) const;
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+protected:
+    /// Cone of directions around \c axis with half-angle <tt>acos(cosTheta)</tt>
+    struct NormalCone {
+        Vector3f axis = Vector3f(0.f, 0.f, 1.f);
+        float cosTheta = 1.f;
+        bool empty = true;
+
+        /// Smallest cone (approximately) that contains both cones
+        static NormalCone merge(const NormalCone &a, const NormalCone &b);
+    };
+
+    /// Bounds of a set of emitting triangles
+    struct LightBounds {
+        BoundingBox3f bbox;
+        NormalCone cone;
+        float power = 0.f;
+
+        void expandBy(const LightBounds &bounds);
+    };
+
+    /**
+     * \brief Node of the hierarchy
+     *
+     * The first child of an interior node directly follows the node in
+     * \ref m_nodes. Every leaf stores a single triangle.
+     */
+    struct Node {
+        BoundingBox3f bbox;
+        Vector3f axis;
+        float cosTheta;
+        float power;
+        /// Index of the second child, or of the triangle for leaves
+        uint32_t offset;
+        bool leaf;
+    };
+
+    /// Emitting triangle, referenced by the leaves
+    struct Primitive {
+        uint32_t emitter;
+        uint32_t face;
+    };
+
+    /// Triangle together with its bounds during the construction
+    struct BuildPrimitive {
+        Primitive primitive;
+        LightBounds bounds;
+        Point3f centroid;
+    };
+
+    /// Recursively build the subtree for the triangles <tt>[start, end)</tt>
+    uint32_t buildRecursive(std::vector<BuildPrimitive> &primitives,
+                            uint32_t start, uint32_t end);
+
+    /// Estimated contribution of a node to the shading point
+    float importance(const Node &node, const Point3f &p, const Normal3f &n) const;
+
+private:
+    std::vector<const Mesh *> m_emitters;
+    std::unordered_map<const Mesh *, uint32_t> m_emitterIndices;
+    std::vector<Primitive> m_primitives;
+    std::vector<Node> m_nodes;
+    /// Parent of every node (needed for the probability lookups)
+    std::vector<uint32_t> m_parents;
+    /// Leaf node of every triangle, starting at \c m_leafOffsets[emitter]
+    std::vector<uint32_t> m_leaves;
+    std::vector<uint32_t> m_leafOffsets;
+};
+
+NORI_NAMESPACE_END
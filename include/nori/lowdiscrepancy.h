@@ -0,0 +1,154 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/hash.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Largest float that is strictly smaller than one
+static const float OneMinusEpsilon = 0.99999994f;
+
+/// Convert 32 random bits into a float on <tt>[0, 1)</tt>
+inline float bitsToFloat(uint32_t bits) {
+    return std::min(bits * 2.3283064365386963e-10f /* 2^-32 */, OneMinusEpsilon);
+}
+
+/// Map a hash value to a uniformly distributed float on <tt>[0, 1)</tt>
+inline float hashToFloat(uint64_t hash) {
+    return bitsToFloat((uint32_t) (mixBits(hash) >> 32));
+}
+
+/**
+ * \brief Return element \c i of a random permutation of <tt>{0, .., n-1}</tt>
+ *
+ * The permutation is determined by \c seed and is evaluated without
+ * storing it (Kensler, "Correlated Multi-Jittered Sampling", 2013).
+ */
+inline uint32_t permutationElement(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+/// Reverse the order of the bits of a 32-bit integer
+inline uint32_t reverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+/**
+ * \brief Hash-based approximation of a random Owen permutation
+ *
+ * Every bit of the result only depends on the bits of \c v that are less
+ * significant, which is exactly the structure of an Owen scramble after
+ * reversing the bits (see Burley, "Practical Hash-based Owen Scrambling",
+ * JCGT 2020, using the improved constants of Laine and Karras).
+ */
+inline uint32_t laineKarrasPermutation(uint32_t v, uint32_t seed) {
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return v;
+}
+
+/**
+ * \brief Owen-scramble a 32-bit fixed point number on <tt>[0, 1)</tt>
+ *
+ * Applied to sample indices, this shuffles the order of the points of a
+ * sequence while keeping its prefixes well distributed.
+ */
+inline uint32_t owenScramble(uint32_t v, uint32_t seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(v), seed));
+}
+
+/// Number of dimensions with Sobol direction numbers in \ref sobolSample()
+static const int SobolDimensions = 4;
+
+/**
+ * \brief Return a component of the unscrambled Sobol sequence as 32-bit
+ * fixed point number
+ *
+ * Only the first four dimensions are provided. Higher-dimensional samples
+ * are obtained by padding with independently shuffled copies of these.
+ */
+inline uint32_t sobolSample(uint32_t index, int dim) {
+    /* Joe-Kuo direction numbers of the first four dimensions */
+    static const uint32_t directions[SobolDimensions][32] = {
+        { 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000,
+          0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000,
+          0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100,
+          0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+        { 0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000,
+          0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000,
+          0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00,
+          0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff },
+        { 0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000,
+          0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000,
+          0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500,
+          0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555 },
+        { 0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000,
+          0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000,
+          0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00,
+          0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093 }
+    };
+
+    uint32_t result = 0;
+    for (int bit = 0; index != 0; index >>= 1, ++bit)
+        if (index & 1)
+            result ^= directions[dim][bit];
+    return result;
+}
+
+/**
+ * \brief Return a component of the shuffled and Owen-scrambled Sobol sequence
+ *
+ * \param index
+ *    Sample index. All components of a sample must use the same \c seed
+ *    for the shuffle so that they remain jointly stratified.
+ * \param dim
+ *    Sobol dimension (less than \ref SobolDimensions)
+ * \param seed
+ *    Seed of the index shuffle
+ * \param scrambleSeed
+ *    Seed of the Owen scramble, which should differ between dimensions
+ */
+inline float sobolOwen(uint32_t index, int dim, uint32_t seed, uint32_t scrambleSeed) {
+    uint32_t shuffled = owenScramble(index, seed);
+    return bitsToFloat(owenScramble(sobolSample(shuffled, dim), scrambleSeed));
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,167 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/ray.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Coarse grid of bounds of a density grid on the unit cube
+ *
+ * Every cell stores the largest density that trilinear interpolation of the
+ * underlying voxels can produce within the cell. Free-flight sampling can
+ * then use tight local majorants instead of the maximum of the whole volume,
+ * which avoids most null collisions in sparse volumes.
+ *
+ * The smallest density within each cell (the minorant) is stored as well.
+ * It serves as the control density of residual ratio tracking.
+ */
+class MajorantGrid {
+public:
+    /// Create an empty grid, whose majorants are all zero
+    MajorantGrid() { }
+
+    /**
+     * \brief Build the grid for a voxel grid on the unit cube
+     *
+     * \param size
+     *    Number of voxels along each axis. Voxel centers are located at
+     *    <tt>(i + 0.5) / size</tt>
+     * \param voxel
+     *    Function that returns the density of a voxel given its indices
+     * \param resolution
+     *    Number of majorant cells along each axis
+     */
+    template <typename Func> void build(const Vector3i &size, const Func &voxel, int resolution) {
+        m_resolution = std::max(resolution, 1);
+        m_majorants.assign(m_resolution * m_resolution * m_resolution, 0.f);
+        m_minorants.assign(m_resolution * m_resolution * m_resolution, 0.f);
+        if (size.minCoeff() <= 0)
+            return;
+
+        for (int z = 0; z < m_resolution; ++z) {
+            for (int y = 0; y < m_resolution; ++y) {
+                for (int x = 0; x < m_resolution; ++x) {
+                    /* Range of voxels that contribute to lookups within the cell */
+                    Point3i cell(x, y, z), lo, hi;
+                    bool border = false;
+                    for (int i = 0; i < 3; ++i) {
+                        lo[i] = (int) std::floor((float) cell[i] / m_resolution * size[i] - .5f);
+                        hi[i] = (int) std::floor((float) (cell[i] + 1) / m_resolution * size[i] - .5f) + 1;
+                        /* Lookups that involve voxels outside of the grid fall off to zero */
+                        border |= lo[i] < 0 || hi[i] >= size[i];
+                        lo[i] = clamp(lo[i], 0, size[i] - 1);
+                        hi[i] = clamp(hi[i], 0, size[i] - 1);
+                    }
+
+                    float majorant = 0.f, minorant = std::numeric_limits<float>::infinity();
+                    for (int vz = lo.z(); vz <= hi.z(); ++vz) {
+                        for (int vy = lo.y(); vy <= hi.y(); ++vy) {
+                            for (int vx = lo.x(); vx <= hi.x(); ++vx) {
+                                float value = voxel(vx, vy, vz);
+                                majorant = std::max(majorant, value);
+                                minorant = std::min(minorant, value);
+                            }
+                        }
+                    }
+                    if (border)
+                        minorant = 0.f;
+
+                    size_t index = (z * m_resolution + y) * m_resolution + x;
+                    m_majorants[index] = majorant;
+                    m_minorants[index] = clamp(minorant, 0.f, majorant);
+                }
+            }
+        }
+    }
+
+    /// Return the number of cells along each axis
+    int getResolution() const { return m_resolution; }
+
+    /// Return the majorant of a cell
+    float getMajorant(const Point3i &cell) const {
+        return m_majorants[(cell.z() * m_resolution + cell.y()) * m_resolution + cell.x()];
+    }
+
+    /// Return the minorant of a cell
+    float getMinorant(const Point3i &cell) const {
+        return m_minorants[(cell.z() * m_resolution + cell.y()) * m_resolution + cell.x()];
+    }
+
+    /**
+     * \brief Iterates over the cells that a ray segment passes through
+     * using a 3D DDA (Amanatides and Woo, "A Fast Voxel Traversal
+     * Algorithm for Ray Tracing", 1987)
+     *
+     * The ray must be given in the coordinate system of the unit cube.
+     */
+    class Iterator {
+    public:
+        Iterator(const MajorantGrid &grid, const Ray3f &ray, float tMin, float tMax)
+            : m_grid(grid), m_t(tMin), m_tMax(tMax) {
+            int res = grid.m_resolution;
+            Point3f p = ray(tMin) * (float) res;
+            for (int i = 0; i < 3; ++i) {
+                m_cell[i] = clamp((int) std::floor(p[i]), 0, res - 1);
+                if (ray.d[i] == 0) {
+                    m_step[i] = 0;
+                    m_deltaT[i] = m_nextT[i] = std::numeric_limits<float>::infinity();
+                } else {
+                    m_step[i] = ray.d[i] > 0 ? 1 : -1;
+                    float boundary = (float) (m_cell[i] + (ray.d[i] > 0 ? 1 : 0)) / res;
+                    m_nextT[i] = tMin + (boundary - ray(tMin)[i]) / ray.d[i];
+                    m_deltaT[i] = 1.f / (res * std::abs(ray.d[i]));
+                }
+            }
+        }
+
+        /**
+         * \brief Return the next segment <tt>[t0, t1)</tt> of the ray
+         * together with the majorant and minorant of its cell
+         *
+         * \return \c false once the end of the ray segment is reached
+         */
+        bool next(float &t0, float &t1, float &majorant, float &minorant) {
+            if (m_t >= m_tMax)
+                return false;
+
+            int axis = 0;
+            if (m_nextT[1] < m_nextT[axis])
+                axis = 1;
+            if (m_nextT[2] < m_nextT[axis])
+                axis = 2;
+
+            t0 = m_t;
+            t1 = std::max(m_t, std::min(m_nextT[axis], m_tMax));
+            majorant = m_grid.getMajorant(m_cell);
+            minorant = m_grid.getMinorant(m_cell);
+
+            /* Step to the neighboring cell */
+            m_t = t1;
+            m_cell[axis] += m_step[axis];
+            m_nextT[axis] += m_deltaT[axis];
+            if (m_cell[axis] < 0 || m_cell[axis] >= m_grid.m_resolution)
+                m_t = m_tMax;
+            return true;
+        }
+
+    private:
+        const MajorantGrid &m_grid;
+        float m_t, m_tMax;
+        Point3i m_cell;
+        Vector3i m_step;
+        Vector3f m_nextT, m_deltaT;
+    };
+
+private:
+    int m_resolution = 1;
+    std::vector<float> m_majorants = std::vector<float>(1, 0.f);
+    std::vector<float> m_minorants = std::vector<float>(1, 0.f);
+};
+
+NORI_NAMESPACE_END
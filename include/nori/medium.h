@@ -23,17 +23,83 @@ public:
 
     virtual Color3f tr(const Ray3f &ray, Sampler *sampler) const = 0;
 
-    virtual Color3f sample(const Ray3f &ray, Sampler *sampler, Intersection &its) const = 0;
+    /**
+     * \brief Sample a free-flight distance along a ray segment
+     *
+     * \param throughput
+     *    Throughput of the path so far. Chromatic media choose the color
+     *    channel that drives distance sampling in proportion to it.
+     * \return
+     *    The transmittance divided by the sampling density, which excludes
+     *    the scattering coefficient at a medium interaction
+     */
+    virtual Color3f sample(const Ray3f &ray, Sampler *sampler, Intersection &its,
+                           const Color3f &throughput = Color3f(1.f)) const = 0;
 
     virtual Color3f sigmaA() const = 0;
 
     virtual Color3f sigmaS() const = 0;
 
-    virtual Color3f getEmittance(const Point3f &point, const Vector3f &w) const { return Color3f(0.6f); }
+    /// Return whether the coefficients are constant, so that the transmittance is analytic
+    virtual bool isHomogeneous() const { return false; }
+
+    /// Return the radiance emitted per unit of absorption (zero unless the medium emits light)
+    virtual Color3f getEmittance(const Point3f &point, const Vector3f &w) const { return Color3f(0.f); }
+
+    /// Return whether the emission of the medium can be sampled with \ref sampleEmission()
+    virtual bool isEmitter() const { return false; }
+
+    /**
+     * \brief Sample a point of the medium in proportion to a bound of its
+     * emitted power
+     *
+     * The medium does not know the shapes that bound it, so the point may
+     * lie outside of them. Callers must discard such points (see the
+     * \c endMedium argument of \ref Scene::evalTransmittance()).
+     *
+     * \param sample
+     *    Three uniformly distributed samples on <tt>[0,1]</tt>
+     * \param p
+     *    Returns the sampled point in world space
+     * \param pdf
+     *    Returns the density of the point with respect to volume
+     * \return
+     *    The radiance emitted per unit length at \c p (the absorption
+     *    coefficient times \ref getEmittance())
+     */
+    virtual Color3f sampleEmission(const Point3f &sample, Point3f &p, float &pdf) const {
+        pdf = 0.f;
+        return Color3f(0.f);
+    }
+
+    /// Return the density of \ref sampleEmission() for a point in world space
+    virtual float pdfEmission(const Point3f &p) const { return 0.f; }
 
     virtual std::shared_ptr<PhaseFunction> getPhase() const { return m_phase; }
 
 protected:
+    /**
+     * \brief Return the probabilities of sampling a distance with each color
+     * channel, which are proportional to the throughput of the path
+     *
+     * The sampled distance is weighted with the balance heuristic over all
+     * channels (single-sample spectral MIS). The resulting weights stay
+     * bounded by the summed throughput, even for strongly chromatic media.
+     */
+    static Color3f channelPdf(const Color3f &throughput) {
+        float sum = throughput.sum();
+        if (!(sum > 0) || !throughput.isValid())
+            return Color3f(1.f / 3.f);
+        return throughput / sum;
+    }
+
+    /// Pick a color channel according to \ref channelPdf()
+    static int sampleChannel(const Color3f &pdf, float sample) {
+        if (sample < pdf.r())
+            return 0;
+        return sample < pdf.r() + pdf.g() ? 1 : 2;
+    }
+
     std::shared_ptr<PhaseFunction> m_phase;
 };
 
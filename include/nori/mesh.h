@@ -36,6 +36,9 @@ public:
     /// Return the surface area of the given triangle
     float surfaceArea(uint32_t index) const;
 
+    /// Return the total surface area (available after \ref activate())
+    float getSurfaceArea() const { return m_dpdf ? m_dpdf->getSum() : 0.f; }
+
     //// Return an axis-aligned bounding box of the entire mesh
     const BoundingBox3f &getBoundingBox() const { return m_bbox; }
 
@@ -45,6 +48,23 @@ public:
     //// Return the centroid of the given triangle
     Point3f getCentroid(uint32_t index) const;
 
+    /**
+     * \brief Uniformly sample a position on the given triangle
+     *
+     * \param index
+     *    Index of the triangle
+     * \param sample
+     *    A uniformly distributed sample on <tt>[0, 1]^2</tt>
+     * \param p
+     *    Returns the sampled position
+     * \param n
+     *    Returns the (interpolated) normal at the sampled position
+     */
+    void samplePosition(uint32_t index, const Point2f &sample, Point3f &p, Vector3f &n) const;
+
+    /// Return the position and (interpolated) normal at the given barycentric coordinates of a triangle
+    void getPosition(uint32_t index, const Vector3f &bary, Point3f &p, Vector3f &n) const;
+
     /** \brief Ray-triangle intersection test
      *
      * Uses the algorithm by Moeller and Trumbore discussed at
@@ -102,6 +122,26 @@ public:
     /// Register a child object (e.g. a BSDF) with the mesh
     virtual void addChild(NoriObject *child);
 
+    /**
+     * \brief Register a named child object with the mesh
+     *
+     * Media named \c "interior" and \c "exterior" fill the two sides of
+     * the surface. The interior is the side that the normals point away from.
+     */
+    virtual void addNamedChild(const std::string &name, NoriObject *child);
+
+    /// Does the scene description specify the media on the sides of this mesh?
+    bool hasMediumInterface() const { return m_interior || m_exterior; }
+
+    /// Return the media on both sides of the surface
+    const MediumInterface &getMediumInterface() const { return m_mediumInterface; }
+
+    /**
+     * \brief Use the given medium on sides of the surface whose medium was
+     * not specified (called by the scene with its unbounded medium)
+     */
+    void setDefaultMedium(const Medium *medium);
+
     /// Return the name of this mesh
     const std::string &getName() const { return m_name; }
 
@@ -126,8 +166,11 @@ protected:
     MatrixXu      m_F;                   ///< Faces
     BSDF         *m_bsdf = nullptr;      ///< BSDF of the surface
     Emitter      *m_emitter = nullptr;   ///< Associated emitter, if any
+    Medium       *m_interior = nullptr;  ///< Medium inside of the mesh, if any
+    Medium       *m_exterior = nullptr;  ///< Medium outside of the mesh, if any
+    MediumInterface m_mediumInterface = MediumInterface(nullptr);
     BoundingBox3f m_bbox;                ///< Bounding box of the mesh
-    std::shared_ptr<DiscretePDF> m_dpdf = nullptr;/// for sampling point from mesh
+    std::shared_ptr<AliasDiscretePDF> m_dpdf = nullptr;/// for sampling point from mesh
 };
 
 NORI_NAMESPACE_END
@@ -50,6 +50,15 @@ public:
      */
     virtual void addChild(NoriObject *child);
 
+    /**
+     * \brief Add a child object that was given a name using the \c name
+     * attribute in the XML file (e.g. the interior medium of a mesh)
+     *
+     * The default implementation does not support named children and
+     * simply throws an exception
+     */
+    virtual void addNamedChild(const std::string &name, NoriObject *child);
+
     /**
      * \brief Set the parent object
      *
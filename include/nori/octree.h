@@ -28,6 +28,8 @@ public:
 					bool shadowRay,
 					uint32_t &face) const override;
 
+  bool RayIntersectAll(const Ray3f &ray, const HitCallback &callback) const override;
+
   std::string ToString() const override;
 
 protected:
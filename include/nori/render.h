@@ -0,0 +1,46 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+#include <functional>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Render all pixels of an image block
+ *
+ * Clears the block and accumulates \c sampleCount camera samples per pixel.
+ * The sampler must have been prepared for the block using
+ * \ref Sampler::prepare() beforehand.
+ */
+extern void renderBlock(const Scene *scene, Sampler *sampler,
+                        ImageBlock &block, size_t sampleCount);
+
+/**
+ * \brief Render pixel samples <tt>[firstSample, sampleCount)</tt> of all
+ * pixels in parallel and accumulate them into \c result
+ *
+ * The samples are rendered in passes of (at most) \c passSize samples per
+ * pixel. After each pass, \c passCallback is invoked with the total number
+ * of samples per pixel contained in \c result. No blocks are in flight
+ * at that point, hence the callback may safely inspect \c result.
+ *
+ * When \c deterministic is set, the blocks of a pass are merged into
+ * \c result in a fixed order, which (together with a sampler that only
+ * depends on the pixel and sample index) makes the image bitwise identical
+ * regardless of the number of threads. This requires memory for one
+ * additional copy of the image.
+ *
+ * The caller is responsible for configuring the TBB thread count.
+ */
+extern void renderImage(const Scene *scene, ImageBlock &result, size_t firstSample,
+                        size_t sampleCount, size_t passSize, bool deterministic = false,
+                        const std::function<void(size_t)> &passCallback = nullptr);
+
+NORI_NAMESPACE_END
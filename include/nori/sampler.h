@@ -32,7 +32,8 @@ class ImageBlock;
  *
  * The general interface between a sampler and a rendering algorithm is as 
  * follows: Before beginning to render a pixel, the rendering algorithm calls 
- * \ref generate(). The first pixel sample can now be computed, after which
+ * \ref generate() with the pixel's coordinates. The first pixel sample can
+ * now be computed, after which
  * \ref advance() needs to be invoked. This repeats until all pixel samples have
  * been exhausted.  While computing a pixel sample, the rendering 
  * algorithm requests (pseudo-) random numbers using the \ref next1D() and
@@ -70,8 +71,13 @@ public:
      * 
      * This function is called initially and every time the 
      * integrator starts rendering a new pixel.
+     *
+     * The samples should only depend on the pixel, the sample index
+     * (starting at the sample offset, see \ref setSampleOffset()) and the
+     * dimension. The rendered image then does not depend on the way in
+     * which pixels are grouped into blocks and assigned to threads.
      */
-    virtual void generate() = 0;
+    virtual void generate(const Point2i &pixel) = 0;
 
     /// Advance to the next sample
     virtual void advance() = 0;
@@ -85,6 +91,23 @@ public:
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /// Change the number of samples per pixel (e.g. to override the scene description)
+    virtual void setSampleCount(size_t sampleCount) { m_sampleCount = sampleCount; }
+
+    /**
+     * \brief Set the index of the first pixel sample that is generated
+     * after the next call to \ref prepare()
+     *
+     * Progressive renders split the pixel samples into several passes.
+     * Samplers take this offset into account so that each pass continues
+     * the sample sequence (instead of repeating the first pass), and so that
+     * a resumed render draws exactly the same samples as an uninterrupted one.
+     */
+    void setSampleOffset(size_t offset) { m_sampleOffset = offset; }
+
+    /// Return the index of the first pixel sample of the current pass
+    size_t getSampleOffset() const { return m_sampleOffset; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -92,6 +115,7 @@ public:
     EClassType getClassType() const { return ESampler; }
 protected:
     size_t m_sampleCount;
+    size_t m_sampleOffset = 0;
 };
 
 NORI_NAMESPACE_END
@@ -7,6 +7,9 @@
 #pragma once
 
 #include <nori/accel.h>
+#include <nori/dpdf.h>
+#include <nori/lightbvh.h>
+#include <unordered_map>
 
 NORI_NAMESPACE_BEGIN
 
@@ -34,9 +37,21 @@ public:
     /// Return a pointer to the scene's integrator
     Integrator *getIntegrator() { return m_integrator; }
 
-    /// Return a pointer to the scene's camera
+    /// Return a pointer to the scene's camera (const version)
     const Camera *getCamera() const { return m_camera; }
 
+    /// Return a pointer to the scene's camera
+    Camera *getCamera() { return m_camera; }
+
+    /**
+     * \brief Replace the scene's camera
+     *
+     * The scene takes ownership of the new camera, which must already be
+     * activated. The previous camera is returned and is now owned by the
+     * caller (this allows restoring it later on).
+     */
+    Camera *setCamera(Camera *camera) { std::swap(camera, m_camera); return camera; }
+
     /// Return a pointer to the scene's sample generator (const version)
     const Sampler *getSampler() const { return m_sampler; }
 
@@ -84,8 +99,43 @@ public:
         return m_accel->rayIntersect(ray, its, true);
     }
 
-    bool rayIntersectTr(const Ray3f &ray, Sampler *sampler,
-                        Intersection &its, Color3f &tr) const;
+    /**
+     * \brief Estimate the transmittance between two points, which is zero
+     * if they are separated by a surface with a BSDF
+     *
+     * \param medium
+     *    The medium at \c p0 (or \c nullptr)
+     * \param endMedium
+     *    If not \c nullptr, returns the medium at \c p1 as found by
+     *    following the medium boundaries from \c p0
+     */
+    Color3f evalTransmittance(const Point3f &p0, const Point3f &p1,
+                              const Medium *medium, Sampler *sampler,
+                              const Medium **endMedium = nullptr) const;
+
+    /// Return the media whose emission can be sampled (see \ref Medium::isEmitter())
+    const std::vector<const Medium *> &getEmissiveMedia() const { return m_emissiveMedia; }
+
+    /**
+     * \brief Sample a point of an emissive medium, which is chosen uniformly
+     *
+     * \param sample
+     *    Three uniformly distributed samples on <tt>[0,1]</tt>
+     * \param p
+     *    Returns the sampled point
+     * \param medium
+     *    Returns the medium that contains \c p
+     * \param pdf
+     *    Returns the density of the point with respect to volume
+     * \return
+     *    The radiance emitted per unit length at \c p (or zero if the
+     *    scene has no emissive media)
+     */
+    Color3f sampleMediumEmission(const Point3f &sample, Point3f &p,
+                                 const Medium *&medium, float &pdf) const;
+
+    /// Return the density of \ref sampleMediumEmission() for a point of a medium
+    float pdfMediumEmission(const Medium *medium, const Point3f &p) const;
 
     /// \brief Return an axis-aligned box that bounds the scene
     const BoundingBox3f &getBoundingBox() const {
@@ -94,6 +144,82 @@ public:
 
   	const std::vector<Mesh*> &getEmitters() const { return m_emitters;}
 
+    /// Return the scene's environment emitter (or \c nullptr if there is none)
+    const Emitter *getEnvironment() const { return m_environment; }
+
+    /**
+     * \brief Return the radiance of the environment emitter that arrives
+     * along a ray that leaves the scene (zero if there is none)
+     */
+    Color3f evalEnvironment(const Ray3f &ray) const;
+
+    /**
+     * \brief Return the solid angle density with which \ref sampleEmitterPosition()
+     * samples the environment emitter in the direction of a ray that leaves
+     * the scene (needed for multiple importance sampling)
+     */
+    float pdfEnvironment(const Ray3f &ray) const;
+
+    /**
+     * \brief Choose one of the scene's emitters for direct illumination
+     *
+     * Emitters are chosen proportionally to their power (i.e. the
+     * luminance of their radiance times their surface area). The power of
+     * the environment emitter is estimated from the bounding sphere of the
+     * scene.
+     *
+     * \param sample
+     *    A uniformly distributed sample on <tt>[0, 1)</tt>, which should be
+     *    drawn from the integrator's \ref Sampler to keep renders reproducible
+     * \param pdf
+     *    Returns the discrete probability of choosing the emitter
+     */
+    const Emitter *sampleEmitter(float sample, float &pdf) const;
+
+    /**
+     * \brief Return the probability that \ref sampleEmitter() chooses
+     * the given emitter (needed for multiple importance sampling)
+     */
+    float pdfEmitter(const Emitter *emitter) const;
+
+    /**
+     * \brief Sample a position on one of the scene's emitters for the
+     * direct illumination of a shading point
+     *
+     * Depending on the \c emitterSampling property of the scene, either the
+     * emitter is chosen by \ref sampleEmitter() and then sampled by area
+     * (\c "power"), or a single triangle is chosen from the \ref LightBVH,
+     * which also accounts for the distance and orientation of the emitters
+     * (\c "bvh"). In the latter case, the environment emitter (if any) is
+     * chosen with its probability under the power-based strategy.
+     *
+     * \param ref
+     *    Position of the shading point
+     * \param n
+     *    Shading normal, or zero if the point is inside a medium
+     * \param sample
+     *    A uniformly distributed sample for the choice of the emitter
+     * \param positionSample
+     *    A uniformly distributed 2D sample for the position on the emitter
+     * \param eRec
+     *    Returns the sampled position and the normal of the emitter
+     * \param pdf
+     *    Returns the density of the direction towards the position with
+     *    respect to solid angle at \c ref, including the discrete choice
+     *    of the emitter
+     * \return
+     *    The chosen emitter, or \c nullptr if no emitter can contribute
+     */
+    const Emitter *sampleEmitterPosition(const Point3f &ref, const Normal3f &n, float sample,
+                                         const Point2f &positionSample, EmitterQueryRecord &eRec,
+                                         float &pdf) const;
+
+    /**
+     * \brief Return the density of \ref sampleEmitterPosition() for a
+     * position on an emitter that was found by tracing a ray
+     */
+    float pdfEmitterPosition(const Point3f &ref, const Normal3f &n, const Intersection &its) const;
+
   	bool illuminatedEachOther(const Point3f &p0, const Point3f &p1) const;
 
     /**
@@ -121,6 +247,12 @@ private:
     Camera *m_camera = nullptr;
     Accel *m_accel = nullptr;
     Medium *m_medium = nullptr;
+    std::vector<const Medium *> m_emissiveMedia;
+    Emitter *m_environment = nullptr;
+    DiscretePDF m_emitterPDF;
+    std::unordered_map<const Emitter *, size_t> m_emitterIndices;
+    bool m_useLightBVH = false;
+    LightBVH m_lightBVH;
 };
 
 NORI_NAMESPACE_END
@@ -0,0 +1,46 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Run a headless render server that keeps scenes resident between jobs
+ *
+ * The server listens on \c address (see \ref Socket for the format) and
+ * reads one request per line. Each request consists of a command followed
+ * by whitespace-separated <tt>key=value</tt> arguments, and is answered by
+ * a single line starting with either \c ok or \c error.
+ *
+ * <tt>render scene=FILE [out=FILE] [spp=N] [origin=X,Y,Z target=X,Y,Z up=X,Y,Z]
+ *        [fov=DEG] [width=N] [height=N]</tt>
+ *     Render a scene and write the result as OpenEXR and PNG file (the
+ *     output name defaults to the scene name). The camera arguments
+ *     replace the scene's camera with a perspective camera for this job
+ *     only and require all three \c lookat arguments.
+ *     Reply: <tt>ok OUTPUT SECONDS cached|loaded</tt>
+ *
+ * <tt>evict scene=FILE</tt>
+ *     Drop a scene from the cache
+ *
+ * <tt>ping</tt>
+ *     Check whether the server is alive
+ *
+ * <tt>shutdown</tt>
+ *     Stop the server once the running job (if any) has finished
+ *
+ * Parsed scenes (including their acceleration data structure) are cached
+ * by their canonical path and reloaded when the modification time of the
+ * scene file or of any file that it references (meshes, textures, density
+ * grids, ..) changes. Jobs are executed one at a time, each of them using
+ * \c threadCount threads.
+ */
+extern void runServer(const std::string &address, int threadCount);
+
+NORI_NAMESPACE_END
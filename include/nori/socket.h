@@ -0,0 +1,81 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Minimal blocking stream socket (TCP or Unix domain)
+ *
+ * Addresses are specified as strings of the form
+ * <tt>host:port</tt>, <tt>:port</tt> (listen on all interfaces) or
+ * <tt>unix:/path/to/socket</tt> for a Unix domain socket.
+ *
+ * All functions report errors by throwing a \ref NoriException,
+ * except for \ref sendAll() and \ref recvAll(), which return \c false
+ * when the connection was closed or broken so that callers can
+ * recover from lost peers.
+ */
+class Socket {
+public:
+    /// Create an unconnected socket
+    Socket() { }
+
+    /// Take ownership of an existing socket descriptor
+    explicit Socket(int fd) : m_fd(fd) { }
+
+    /// Close the socket
+    ~Socket() { close(); }
+
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    /// Connect to a listening socket at the given address
+    static std::unique_ptr<Socket> connect(const std::string &address);
+
+    /// Create a socket that listens for connections on the given address
+    static std::unique_ptr<Socket> listen(const std::string &address);
+
+    /**
+     * \brief Wait for an incoming connection
+     *
+     * \param timeout
+     *     Timeout in milliseconds (negative: wait indefinitely)
+     * \return
+     *     The connected socket, or \c nullptr when the timeout expired
+     */
+    std::unique_ptr<Socket> accept(int timeout = -1);
+
+    /// Send a buffer of the given size
+    bool sendAll(const void *data, size_t size);
+
+    /**
+     * \brief Receive a buffer of the given size
+     *
+     * \param timeout
+     *     Time limit in milliseconds for receiving the entire buffer
+     *     (negative: wait indefinitely). Returns \c false when it expires.
+     */
+    bool recvAll(void *data, size_t size, int timeout = -1);
+
+    /// Shut down both directions of the connection, waking up blocked calls
+    void shutdown();
+
+    /// Close the connection
+    void close();
+
+    /// Is the socket open?
+    bool isOpen() const { return m_fd >= 0; }
+private:
+    int m_fd = -1;
+    std::string m_unlinkPath; ///< Unix socket file to be removed on close
+};
+
+NORI_NAMESPACE_END
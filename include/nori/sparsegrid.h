@@ -0,0 +1,153 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/densitygrid.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Sparse voxel grid made of constant tiles and dense bricks
+ *
+ * The grid is split into tiles of 8x8x8 voxels (similar to the leaf nodes
+ * of OpenVDB). Tiles whose voxels all have the same value (typically
+ * empty space) only store that value, all other tiles point to a dense
+ * brick of 512 values. The memory usage is therefore proportional to the
+ * number of voxels in non-constant tiles, plus a small table with one
+ * entry per tile.
+ *
+ * The representation is lossless, and a lookup costs one access to the
+ * tile table and (for non-constant tiles) one access to a brick.
+ *
+ * The grid is surrounded by a border of empty tiles, which only cost an
+ * entry of the tile table each. This lets trilinear lookups fetch all
+ * eight corners after a single bounds test, and the corners usually lie
+ * within one tile.
+ */
+class SparseGrid {
+public:
+    /// Number of voxels of a tile along each axis (as a power of two)
+    static const int TileLog2 = 3;
+    static const int TileSize = 1 << TileLog2;
+    static const int TileVoxels = TileSize * TileSize * TileSize;
+
+    /// Create an empty grid
+    SparseGrid() { }
+
+    /// Build the sparse representation of a dense grid
+    void build(const DensityGrid &grid);
+
+    /// Return the number of voxels along each axis
+    const Vector3i &getSize() const { return m_size; }
+
+    /// Return the extent of the grid in object space
+    const BoundingBox3f &getBounds() const { return m_bounds; }
+
+    /// Return the largest value of the grid
+    float getMaxDensity() const { return m_maxDensity; }
+
+    /// Return the number of tiles that are stored as dense bricks
+    size_t getBrickCount() const { return m_bricks.size() / TileVoxels; }
+
+    /// Return the approximate memory usage in bytes
+    size_t getMemoryUsage() const {
+        return m_tiles.size() * sizeof(Tile) + m_bricks.size() * sizeof(float);
+    }
+
+    /// Return the value of a voxel (which must lie within the grid)
+    float operator()(int x, int y, int z) const {
+        return voxel(x + TileSize, y + TileSize, z + TileSize);
+    }
+
+    /**
+     * \brief Trilinearly interpolate the grid at a point of the unit cube
+     *
+     * Voxel centers are located at <tt>(i + 0.5) / size</tt>, and the
+     * grid falls off to zero outside of its voxels.
+     */
+    float lookup(const Point3f &p) const {
+        /* Position relative to the padded grid. Lookups within one voxel of
+           the grid involve the border, lookups further outside are zero */
+        const float offset = TileSize - .5f;
+        float x = p.x() * m_size.x() + offset, y = p.y() * m_size.y() + offset, z = p.z() * m_size.z() + offset;
+        if (!(x >= TileSize - 1 && y >= TileSize - 1 && z >= TileSize - 1 &&
+              x < m_size.x() + TileSize && y < m_size.y() + TileSize && z < m_size.z() + TileSize))
+            return 0.f;
+
+        int ix = (int) x, iy = (int) y, iz = (int) z;
+        float c[8];
+        fetchCorners(ix, iy, iz, c);
+
+        float dx = x - ix, dy = y - iy, dz = z - iz;
+        Eigen::Array4f c0(c[0], c[1], c[2], c[3]), c1(c[4], c[5], c[6], c[7]);
+        Eigen::Array4f cz = c0 + dz * (c1 - c0);
+        float cy0 = cz[0] + dy * (cz[2] - cz[0]);
+        float cy1 = cz[1] + dy * (cz[3] - cz[1]);
+        return cy0 + dx * (cy1 - cy0);
+    }
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    static const uint32_t ConstantTile = (uint32_t) -1;
+
+    /// Return the value of a voxel of the padded grid
+    float voxel(int x, int y, int z) const {
+        const Tile &tile = m_tiles[((z >> TileLog2) * m_tileCount.y() + (y >> TileLog2)) * m_tileCount.x() + (x >> TileLog2)];
+        if (tile.brick == ConstantTile)
+            return tile.value;
+        const int mask = TileSize - 1;
+        return m_bricks[(size_t) tile.brick * TileVoxels +
+            ((((z & mask) << TileLog2) + (y & mask)) << TileLog2) + (x & mask)];
+    }
+
+    /**
+     * Fetch the eight voxels of the padded grid from <tt>(x, y, z)</tt> to
+     * <tt>(x + 1, y + 1, z + 1)</tt>. Corner \c i is offset by bit 0 of
+     * \c i along X, bit 1 along Y and bit 2 along Z.
+     */
+    void fetchCorners(int x, int y, int z, float *c) const {
+        const int mask = TileSize - 1;
+        if ((x & mask) != mask && (y & mask) != mask && (z & mask) != mask) {
+            /* All corners lie within one tile */
+            const Tile &tile = m_tiles[((z >> TileLog2) * m_tileCount.y() + (y >> TileLog2)) * m_tileCount.x() + (x >> TileLog2)];
+            if (tile.brick == ConstantTile) {
+                for (int i = 0; i < 8; ++i)
+                    c[i] = tile.value;
+                return;
+            }
+            const float *v = &m_bricks[(size_t) tile.brick * TileVoxels +
+                ((((z & mask) << TileLog2) + (y & mask)) << TileLog2) + (x & mask)];
+            const int dy = TileSize, dz = TileSize * TileSize;
+            c[0] = v[0];      c[1] = v[1];
+            c[2] = v[dy];     c[3] = v[dy + 1];
+            c[4] = v[dz];     c[5] = v[dz + 1];
+            c[6] = v[dz + dy]; c[7] = v[dz + dy + 1];
+        } else {
+            for (int i = 0; i < 8; ++i)
+                c[i] = voxel(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2));
+        }
+    }
+
+    struct Tile {
+        /// Value of all voxels of a constant tile
+        float value;
+        /// Index of the brick, or \ref ConstantTile
+        uint32_t brick;
+    };
+
+    /// Size of the grid without the padding
+    Vector3i m_size = Vector3i::Zero();
+    Vector3i m_tileCount = Vector3i::Zero();
+    BoundingBox3f m_bounds;
+    float m_maxDensity = 0.f;
+    std::vector<Tile> m_tiles;
+    std::vector<float> m_bricks;
+};
+
+NORI_NAMESPACE_END
@@ -61,6 +61,20 @@ public:
     static float squareToGGXPdf(const Vector3f &m, float alpha);
 
     static float phaseHG(float cosTheta, float g);
+
+    /**
+     * \brief Uniformly sample a direction within the spherical triangle with
+     * the given (normalized) vertices with respect to solid angles
+     *
+     * Uses the method of Arvo, "Stratified Sampling of Spherical Triangles"
+     * (SIGGRAPH 1995). The returned direction has the density
+     * <tt>1 / sphericalTriangleArea(a, b, c)</tt>.
+     */
+    static Vector3f squareToSphericalTriangle(const Point2f &sample, const Vector3f &a,
+                                              const Vector3f &b, const Vector3f &c);
+
+    /// Solid angle covered by the spherical triangle with the given (normalized) vertices
+    static float sphericalTriangleArea(const Vector3f &a, const Vector3f &b, const Vector3f &c);
 };
 
 NORI_NAMESPACE_END
@@ -73,6 +73,8 @@ bool Accel::rayIntersect(const Ray3f &ray_, Intersection &its, bool shadowRay) c
 
         /* References to all relevant mesh buffers */
         const Mesh *mesh   = its.mesh;
+        its.face = f;
+        its.mediumInterface = mesh->getMediumInterface();
         const MatrixXf &V  = mesh->getVertexPositions();
         const MatrixXf &N  = mesh->getVertexNormals();
         const MatrixXf &UV = mesh->getVertexTexCoords();
@@ -5,6 +5,7 @@
 #include <nori/emitter.h>
 #include <nori/mesh.h>
 #include <nori/dpdf.h>
+#include <nori/warp.h>
 #include <Eigen/Dense>
 
 NORI_NAMESPACE_BEGIN
@@ -13,6 +14,14 @@ class AreaLight : public Emitter {
 public:
     AreaLight(const PropertyList &props) {
         m_radiance = props.getColor("radiance", Color3f(1.f));
+
+        /* Sample positions uniformly by area ("area"), or uniformly within the
+           solid angle that the chosen triangle subtends ("solidAngle") */
+        std::string sampling = props.getString("sampling", "area");
+        if (sampling == "solidAngle")
+            m_solidAngleSampling = true;
+        else if (sampling != "area")
+            throw NoriException("AreaLight: unknown sampling mode \"%s\"", sampling);
     }
 
     void setParent(NoriObject *parent) override {
@@ -22,7 +31,7 @@ public:
     void build() override {
         Mesh *pMesh = dynamic_cast<Mesh *>(m_parent);
         auto face_count = pMesh->getTriangleCount();
-        m_DPDF = std::make_shared<DiscretePDF>(face_count);
+        m_DPDF = std::make_shared<AliasDiscretePDF>(face_count);
         for (uint32_t face_index = 0; face_index < face_count; ++face_index) {
             m_DPDF->append(pMesh->surfaceArea(face_index));
         }
@@ -36,27 +45,28 @@ public:
     Color3f sample(const Point3f &surfacePoint, EmitterQueryRecord &eRec, const Point2f &sample) const override {
         Mesh *pMesh = dynamic_cast<Mesh *>(m_parent);
         float eps1 = sample.x();
-        float esp2 = sample.y();
         auto face_index = m_DPDF->sampleReuse(eps1);
-        auto alpha = 1.f - std::sqrtf(1.f - eps1);
-        auto beta = esp2 * std::sqrtf(1.f - eps1);
-        auto gamma = 1.f - alpha - beta;
-
-        auto i0 = pMesh->getIndices()(0, face_index);
-        auto i1 = pMesh->getIndices()(1, face_index);
-        auto i2 = pMesh->getIndices()(2, face_index);
-        Point3f p0 = pMesh->getVertexPositions().col(i0);
-        Point3f p1 = pMesh->getVertexPositions().col(i1);
-        Point3f p2 = pMesh->getVertexPositions().col(i2);
-        eRec.point = alpha * p0 + beta * p1 + gamma * p2;
-        if (pMesh->getVertexNormals().size() > 0) {
-            eRec.normal = (alpha * pMesh->getVertexNormals().col(i0) +
-                           beta * pMesh->getVertexNormals().col(i1) +
-                           gamma * pMesh->getVertexNormals().col(i2)).normalized();
-        } else {
-            eRec.normal = (p1 - p0).cross(p2 - p0).normalized();
+        eRec.ref = surfacePoint;
+        eRec.face = face_index;
+
+        Vector3f a, b, c;
+        if (m_solidAngleSampling && sphericalTriangle(pMesh, face_index, surfacePoint, a, b, c)) {
+            /* Sample a direction towards the triangle and find the point it hits */
+            Vector3f d = Warp::squareToSphericalTriangle(Point2f(eps1, sample.y()), a, b, c);
+            float u, v, t;
+            if (!pMesh->rayIntersect(face_index, Ray3f(surfacePoint, d), u, v, t))
+                return Color3f(0.f);
+            pMesh->getPosition(face_index, Vector3f(1 - u - v, u, v), eRec.point, eRec.normal);
+            eRec.measure = ESolidAngle;
+            float pdfValue = pdf(eRec);
+            if (eRec.normal.dot(surfacePoint - eRec.point) <= 0 || pdfValue <= 0)
+                return Color3f(0.f);
+            return eval(eRec) / pdfValue;
         }
 
+        pMesh->samplePosition(face_index, Point2f(eps1, sample.y()), eRec.point, eRec.normal);
+        eRec.measure = EArea;
+
         Vector3f wo = surfacePoint - eRec.point;
         float squaredDis = wo.squaredNorm();
         wo = wo.normalized();
@@ -64,7 +74,23 @@ public:
     }
 
     float pdf(const EmitterQueryRecord &bRec) const override {
-        return m_DPDF->getNormalization();
+        Vector3f d = bRec.point - bRec.ref;
+        float squaredDis = d.squaredNorm();
+        float cosTheta = std::abs(bRec.normal.dot(d)) / std::sqrt(squaredDis);
+
+        Vector3f a, b, c;
+        if (m_solidAngleSampling && bRec.face != (uint32_t) -1 &&
+            sphericalTriangle(dynamic_cast<Mesh *>(m_parent), bRec.face, bRec.ref, a, b, c)) {
+            float pdfSolidAngle = (*m_DPDF)[bRec.face] / Warp::sphericalTriangleArea(a, b, c);
+            if (bRec.measure == ESolidAngle)
+                return pdfSolidAngle;
+            return squaredDis > 0 ? pdfSolidAngle * cosTheta / squaredDis : 0.f;
+        }
+
+        float pdfArea = m_DPDF->getNormalization();
+        if (bRec.measure != ESolidAngle)
+            return pdfArea;
+        return cosTheta > 0 ? pdfArea * squaredDis / cosTheta : 0.f;
     }
 
     Color3f emission() const override {
@@ -72,14 +98,33 @@ public:
     }
 
     std::string toString() const override {
-        return "AreaLight[]";
+        return tfm::format("AreaLight[radiance=%s, sampling=%s]",
+                           m_radiance.toString(), m_solidAngleSampling ? "solidAngle" : "area");
     }
 
 private:
+    /**
+     * Project a triangle onto the unit sphere around \c ref. Fails if the
+     * solid angle is too small or too large for robust spherical triangle
+     * sampling, in which case the triangle is sampled by area instead.
+     */
+    static bool sphericalTriangle(const Mesh *pMesh, uint32_t face_index, const Point3f &ref,
+                                  Vector3f &a, Vector3f &b, Vector3f &c) {
+        const float MinSolidAngle = 3e-4f, MaxSolidAngle = 6.22f;
+        const MatrixXu &F = pMesh->getIndices();
+        const MatrixXf &V = pMesh->getVertexPositions();
+        a = (Point3f(V.col(F(0, face_index))) - ref).normalized();
+        b = (Point3f(V.col(F(1, face_index))) - ref).normalized();
+        c = (Point3f(V.col(F(2, face_index))) - ref).normalized();
+        float solidAngle = Warp::sphericalTriangleArea(a, b, c);
+        return solidAngle >= MinSolidAngle && solidAngle <= MaxSolidAngle;
+    }
+
     NoriObject *m_parent{nullptr};
     Color3f m_radiance;
-    std::shared_ptr<DiscretePDF> m_DPDF = nullptr;/// for sampling point from mesh
+    bool m_solidAngleSampling = false;
+    std::shared_ptr<AliasDiscretePDF> m_DPDF = nullptr;/// for sampling point from mesh
 };
 
 NORI_REGISTER_CLASS(AreaLight, "area");
-NORI_NAMESPACE_END
\ No newline at end of file
+NORI_NAMESPACE_END
@@ -107,10 +107,19 @@ std::string ImageBlock::toString() const {
 }
 
 BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
+        : BlockGenerator(size, blockSize, Point2i(0, 0), size) { }
+
+BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize,
+                               const Point2i &cropOffset, const Vector2i &cropSize)
         : m_size(size), m_blockSize(blockSize) {
+    m_cropStart = cropOffset;
+    m_cropEnd = cropOffset + cropSize;
+
+    /* Range of grid cells that overlap the crop window */
+    m_firstBlock = Point2i(m_cropStart.x() / blockSize, m_cropStart.y() / blockSize);
     m_numBlocks = Vector2i(
-        (int) std::ceil(size.x() / (float) blockSize),
-        (int) std::ceil(size.y() / (float) blockSize));
+        (m_cropEnd.x() + blockSize - 1) / blockSize - m_firstBlock.x(),
+        (m_cropEnd.y() + blockSize - 1) / blockSize - m_firstBlock.y());
     m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
     m_direction = ERight;
     m_block = Point2i(m_numBlocks / 2);
@@ -124,9 +133,11 @@ bool BlockGenerator::next(ImageBlock &block) {
     if (m_blocksLeft == 0)
         return false;
 
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
-    block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
+    Point2i pos = (m_firstBlock + m_block) * m_blockSize;
+    Point2i start = pos.cwiseMax(m_cropStart);
+    Point2i end = (pos + Vector2i::Constant(m_blockSize)).cwiseMin(m_cropEnd);
+    block.setOffset(start);
+    block.setSize(Vector2i(end.x() - start.x(), end.y() - start.y()));
 
     if (--m_blocksLeft == 0)
         return true;
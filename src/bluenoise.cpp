@@ -0,0 +1,247 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/lowdiscrepancy.h>
+#include <pcg32.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Blue-noise screen-space sampler for low sample counts
+ *
+ * Each pixel sample is a point of the additive recurrence (Kronecker
+ * sequence) <tt>frac(u + i * alpha)</tt>, which has low discrepancy for
+ * every prefix. The first two dimensions (usually the position within the
+ * pixel) use the R2 sequence. Every further dimension uses its own
+ * increment <tt>alpha = frac(sqrt(p))</tt> for a different prime \c p.
+ * These are linearly independent over the rationals, so dimensions are
+ * not shifted copies of each other. The Cranley-Patterson rotation \c u of a
+ * pixel is read from a tiled blue-noise mask, using a different toroidal
+ * offset of the mask for every dimension. Neighboring pixels thus receive
+ * very different rotations, and the error of renders with 1-4 samples per
+ * pixel is pushed into high frequencies, where it is far less visible and
+ * easier to remove with a denoiser than white noise.
+ *
+ * The mask is generated on construction with the void-and-cluster method
+ * (Ulichney 1993) and is shared between all clones of the sampler.
+ */
+class BlueNoiseSampler : public Sampler {
+public:
+    BlueNoiseSampler(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Resolution of the tiled blue-noise mask */
+        m_maskSize = propList.getInteger("maskSize", 64);
+        if (m_maskSize < 4 || m_maskSize > 128)
+            throw NoriException("BlueNoiseSampler: the mask size must be in [4, 128]");
+
+        /* Seed for the mask and the dimension offsets */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+
+        m_mask = generateMask(m_maskSize, m_seed);
+    }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<BlueNoiseSampler> cloned(new BlueNoiseSampler());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_maskSize = m_maskSize;
+        cloned->m_seed = m_seed;
+        cloned->m_mask = m_mask; /* Shared, not copied */
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixel = pixel;
+        m_sampleIndex = m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t dim = m_dimension++;
+        return rotate(maskValue(dim), alpha(dim));
+    }
+
+    Point2f next2D() {
+        uint32_t dim = m_dimension;
+        m_dimension += 2;
+        return Point2f(
+            rotate(maskValue(dim), alpha(dim)),
+            rotate(maskValue(dim + 1), alpha(dim + 1))
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format("BlueNoiseSampler[sampleCount=%i, maskSize=%i, seed=%i]",
+                           m_sampleCount, m_maskSize, m_seed);
+    }
+protected:
+    BlueNoiseSampler() { }
+
+    /// Blue-noise rotation of the current pixel in the given dimension
+    float maskValue(uint32_t dim) const {
+        uint64_t hash = hashCombine(m_seed, dim);
+        int x = (int) ((m_pixel.x() + (hash & 0xFFFF)) % m_maskSize);
+        int y = (int) ((m_pixel.y() + ((hash >> 16) & 0xFFFF)) % m_maskSize);
+        return (*m_mask)[y * m_maskSize + x];
+    }
+
+    /**
+     * Increment of the sequence in the given dimension. Dimensions beyond
+     * the table reuse its increments, with a different rotation
+     */
+    static double alpha(uint32_t dim) {
+        static const std::vector<double> table = [] {
+            const int count = 256;
+            /* R2 sequence, based on the plastic number */
+            std::vector<double> alphas = { 0.7548776662466927, 0.5698402909980532 };
+            for (int p = 2; (int) alphas.size() < count; ++p) {
+                bool prime = true;
+                for (int q = 2; q * q <= p && prime; ++q)
+                    prime = p % q != 0;
+                if (prime) {
+                    double root = std::sqrt((double) p);
+                    alphas.push_back(root - std::floor(root));
+                }
+            }
+            return alphas;
+        }();
+        return table[dim % table.size()];
+    }
+
+    /// Rotated sequence element for the current sample index
+    float rotate(float u, double alpha) const {
+        double value = u + alpha * (double) m_sampleIndex;
+        return std::min((float) (value - std::floor(value)), OneMinusEpsilon);
+    }
+
+    /**
+     * \brief Generate a tileable blue-noise mask with values that are
+     * uniformly distributed on <tt>[0, 1)</tt>
+     *
+     * Void-and-cluster: pixels are ranked by repeatedly removing the
+     * tightest cluster from (or filling the largest void of) a binary
+     * pattern, where clusters and voids are found using a Gaussian
+     * energy filter on the torus.
+     */
+    static std::shared_ptr<const std::vector<float>> generateMask(int size, uint32_t seed) {
+        const int n = size * size;
+        const float sigma = 1.5f;
+
+        /* Toroidal Gaussian filter, indexed by the wrapped offset */
+        std::vector<float> kernel(n);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+
+        std::vector<bool> pattern(n, false);
+        std::vector<float> energy(n, 0.f);
+        auto toggle = [&](int index) {
+            float sign = pattern[index] ? -1.f : 1.f;
+            pattern[index] = !pattern[index];
+            int px = index % size, py = index / size;
+            for (int y = 0; y < size; ++y) {
+                int ky = (y - py + size) % size;
+                for (int x = 0; x < size; ++x) {
+                    int kx = (x - px + size) % size;
+                    energy[y * size + x] += sign * kernel[ky * size + kx];
+                }
+            }
+        };
+        /* Tightest cluster: the set pixel with the highest energy */
+        auto tightestCluster = [&]() {
+            int best = -1;
+            for (int i = 0; i < n; ++i)
+                if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+                    best = i;
+            return best;
+        };
+        /* Largest void: the empty pixel with the lowest energy */
+        auto largestVoid = [&]() {
+            int best = -1;
+            for (int i = 0; i < n; ++i)
+                if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+                    best = i;
+            return best;
+        };
+
+        /* Initial binary pattern: random points, relaxed until the tightest
+           cluster and the largest void coincide */
+        pcg32 random(seed, 0x9e3779b97f4a7c15ULL);
+        int onesCount = std::max(1, n / 10);
+        for (int i = 0; i < onesCount; ) {
+            int index = (int) random.nextUInt((uint32_t) n);
+            if (!pattern[index]) {
+                toggle(index);
+                ++i;
+            }
+        }
+        for (int iteration = 0; iteration < 10 * n; ++iteration) {
+            int cluster = tightestCluster();
+            toggle(cluster);
+            int voidIndex = largestVoid();
+            if (voidIndex == cluster) {
+                toggle(cluster);
+                break;
+            }
+            toggle(voidIndex);
+        }
+        std::vector<bool> initialPattern = pattern;
+        std::vector<float> initialEnergy = energy;
+
+        std::vector<int> rank(n, 0);
+
+        /* Phase 1: rank the initial points by removing clusters */
+        for (int r = onesCount - 1; r >= 0; --r) {
+            int cluster = tightestCluster();
+            toggle(cluster);
+            rank[cluster] = r;
+        }
+
+        /* Phases 2 and 3: rank the remaining pixels by filling voids. (The
+           tightest cluster of zeros in the inverted pattern of phase 3 is
+           exactly the largest void, since the energies of the ones and the
+           zeros add up to a constant) */
+        pattern = initialPattern;
+        energy = initialEnergy;
+        for (int r = onesCount; r < n; ++r) {
+            int voidIndex = largestVoid();
+            toggle(voidIndex);
+            rank[voidIndex] = r;
+        }
+
+        std::shared_ptr<std::vector<float>> mask = std::make_shared<std::vector<float>>(n);
+        for (int i = 0; i < n; ++i)
+            (*mask)[i] = (rank[i] + 0.5f) / n;
+        return mask;
+    }
+
+private:
+    int m_maskSize = 64;
+    uint32_t m_seed = 0;
+    std::shared_ptr<const std::vector<float>> m_mask;
+    Point2i m_pixel = Point2i(0, 0);
+    uint64_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(BlueNoiseSampler, "bluenoise");
+NORI_NAMESPACE_END
@@ -0,0 +1,158 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/checkpoint.h>
+#include <nori/block.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/sampler.h>
+#include <nori/hash.h>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#if defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/* Binary layout of a checkpoint file (native byte order) */
+struct CheckpointHeader {
+    char magic[8];          ///< "NORICKPT"
+    uint32_t version;       ///< File format version
+    int32_t width, height;  ///< Size of the image (excluding the border)
+    int32_t borderSize;     ///< Border size of the reconstruction filter
+    uint64_t samplesDone;   ///< Pixel samples that have been accumulated
+    uint64_t sampleCount;   ///< Total pixel samples of the render
+    int32_t cropOffset[2];  ///< Crop window of the camera
+    int32_t cropSize[2];
+    uint64_t samplerHash;   ///< Hash of the sampler's description (type, seed, ..)
+    uint64_t sceneHash;     ///< Hash of the scene's description
+};
+
+static const char *checkpointMagic = "NORICKPT";
+static const uint32_t checkpointVersion = 2;
+
+static uint64_t hashString(const std::string &str) {
+    uint64_t hash = str.size();
+    for (char c : str)
+        hash = hashCombine(hash, (uint64_t) (unsigned char) c);
+    return hash;
+}
+
+/// Describe the render that \c block belongs to
+static CheckpointHeader createHeader(const Scene *scene, const ImageBlock &block, size_t samplesDone) {
+    const Camera *camera = scene->getCamera();
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(CheckpointHeader));
+    memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = checkpointVersion;
+    header.width = block.getSize().x();
+    header.height = block.getSize().y();
+    header.borderSize = block.getBorderSize();
+    header.samplesDone = (uint64_t) samplesDone;
+    header.sampleCount = (uint64_t) scene->getSampler()->getSampleCount();
+    header.cropOffset[0] = camera->getCropOffset().x();
+    header.cropOffset[1] = camera->getCropOffset().y();
+    header.cropSize[0] = camera->getCropSize().x();
+    header.cropSize[1] = camera->getCropSize().y();
+    header.samplerHash = hashString(scene->getSampler()->toString());
+    header.sceneHash = hashString(scene->toString());
+    return header;
+}
+
+void saveCheckpoint(const std::string &filename, const Scene *scene,
+                    const ImageBlock &block, size_t samplesDone) {
+    CheckpointHeader header = createHeader(scene, block, samplesDone);
+
+    /* Write to a temporary file first and rename it afterwards. The rename
+       replaces a previous checkpoint atomically, hence a crash at any point
+       leaves either the old or the new checkpoint intact */
+    std::string tmpName = filename + ".tmp";
+    FILE *file = fopen(tmpName.c_str(), "wb");
+    if (!file)
+        throw NoriException("saveCheckpoint(): could not open \"%s\" for writing", tmpName);
+
+    bool good = fwrite(&header, sizeof(CheckpointHeader), 1, file) == 1;
+    for (int y = 0; y < block.rows() && good; ++y)
+        for (int x = 0; x < block.cols() && good; ++x)
+            good = fwrite(block.coeff(y, x).data(), sizeof(float), 4, file) == 4;
+
+    /* Make sure that the data is on disk before the rename makes it visible */
+    good &= fflush(file) == 0;
+#if defined(PLATFORM_WINDOWS)
+    good &= _commit(_fileno(file)) == 0;
+#else
+    good &= fsync(fileno(file)) == 0;
+#endif
+    good &= fclose(file) == 0;
+    if (!good)
+        throw NoriException("saveCheckpoint(): error while writing \"%s\"", tmpName);
+
+#if defined(PLATFORM_WINDOWS)
+    bool renamed = MoveFileExA(tmpName.c_str(), filename.c_str(),
+                               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool renamed = std::rename(tmpName.c_str(), filename.c_str()) == 0;
+#endif
+    if (!renamed)
+        throw NoriException("saveCheckpoint(): could not rename \"%s\" to \"%s\"", tmpName, filename);
+}
+
+size_t loadCheckpoint(const std::string &filename, const Scene *scene,
+                      ImageBlock &block) {
+    CheckpointHeader expected = createHeader(scene, block, 0);
+
+    std::ifstream is(filename, std::ios::binary);
+    if (!is.is_open())
+        throw NoriException("loadCheckpoint(): could not open \"%s\"", filename);
+
+    CheckpointHeader header;
+    is.read(reinterpret_cast<char *>(&header), sizeof(CheckpointHeader));
+    if (!is.good() || memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0)
+        throw NoriException("loadCheckpoint(): \"%s\" is not a Nori checkpoint", filename);
+    if (header.version != checkpointVersion)
+        throw NoriException("loadCheckpoint(): \"%s\" has an unsupported version (%i)",
+                            filename, header.version);
+    if (header.width != expected.width || header.height != expected.height ||
+        header.borderSize != expected.borderSize)
+        throw NoriException("loadCheckpoint(): the resolution or reconstruction filter of \"%s\" "
+                            "does not match the scene", filename);
+    if (header.sampleCount != expected.sampleCount || header.samplesDone > header.sampleCount)
+        throw NoriException("loadCheckpoint(): the sample count of \"%s\" does not match the scene "
+                            "(%i vs. %i)", filename, header.sampleCount, expected.sampleCount);
+    if (memcmp(header.cropOffset, expected.cropOffset, sizeof(header.cropOffset)) != 0 ||
+        memcmp(header.cropSize, expected.cropSize, sizeof(header.cropSize)) != 0)
+        throw NoriException("loadCheckpoint(): the crop window of \"%s\" ([%i, %i], %ix%i) does not "
+                            "match the render ([%i, %i], %ix%i)", filename,
+                            header.cropOffset[0], header.cropOffset[1], header.cropSize[0], header.cropSize[1],
+                            expected.cropOffset[0], expected.cropOffset[1], expected.cropSize[0], expected.cropSize[1]);
+    if (header.samplerHash != expected.samplerHash)
+        throw NoriException("loadCheckpoint(): \"%s\" was rendered with a different sampler "
+                            "(type or seed) than %s", filename, scene->getSampler()->toString());
+    if (header.sceneHash != expected.sceneHash)
+        throw NoriException("loadCheckpoint(): \"%s\" was rendered from a different version "
+                            "of the scene", filename);
+
+    for (int y = 0; y < block.rows(); ++y) {
+        for (int x = 0; x < block.cols(); ++x) {
+            float value[4];
+            is.read(reinterpret_cast<char *>(value), sizeof(value));
+            block.coeffRef(y, x) = Color4f(value[0], value[1], value[2], value[3]);
+        }
+    }
+
+    if (!is.good())
+        throw NoriException("loadCheckpoint(): \"%s\" is truncated", filename);
+
+    return (size_t) header.samplesDone;
+}
+
+NORI_NAMESPACE_END
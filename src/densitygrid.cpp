@@ -0,0 +1,175 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/densitygrid.h>
+#include <fstream>
+#include <cstring>
+
+#if defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+static const char *GridMagic = "NVOL";
+static const uint32_t GridVersion = 1;
+
+static_assert(sizeof(DensityGrid::Header) == 64, "Unexpected size of the grid header");
+
+MemoryMappedFile::MemoryMappedFile(const std::string &filename) {
+#if defined(PLATFORM_WINDOWS)
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        throw NoriException("Unable to open \"%s\"!", filename);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        CloseHandle(m_file);
+        throw NoriException("Unable to determine the size of \"%s\"!", filename);
+    }
+    m_size = (size_t) size.QuadPart;
+    if (m_size == 0)
+        return;
+    m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+        m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data) {
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw NoriException("Unable to map \"%s\" into memory!", filename);
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw NoriException("Unable to open \"%s\"!", filename);
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw NoriException("Unable to determine the size of \"%s\"!", filename);
+    }
+    m_size = (size_t) st.st_size;
+    if (m_size == 0) {
+        close(fd);
+        return;
+    }
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    /* The mapping remains valid after closing the descriptor */
+    close(fd);
+    if (data == MAP_FAILED)
+        throw NoriException("Unable to map \"%s\" into memory!", filename);
+    m_data = data;
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+#if defined(PLATFORM_WINDOWS)
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap(const_cast<void *>(m_data), m_size);
+#endif
+}
+
+void DensityGrid::load(const std::string &filename) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is.is_open())
+        throw NoriException("DensityGrid: unable to open \"%s\"!", filename);
+    char magic[4] = { 0 };
+    is.read(magic, 4);
+    is.close();
+    if (std::memcmp(magic, GridMagic, 4) != 0) {
+        loadText(filename);
+        return;
+    }
+
+    m_values.clear();
+    m_file.reset(new MemoryMappedFile(filename));
+    if (m_file->getSize() < sizeof(Header))
+        throw NoriException("DensityGrid: \"%s\" is truncated!", filename);
+
+    Header header;
+    std::memcpy(&header, m_file->getData(), sizeof(Header));
+    if (header.version != GridVersion)
+        throw NoriException("DensityGrid: \"%s\" has unsupported version %i!", filename, header.version);
+    if (header.dataType != EFloat32)
+        throw NoriException("DensityGrid: \"%s\" has unsupported data type %i!", filename, header.dataType);
+    m_size = Vector3i(header.size[0], header.size[1], header.size[2]);
+    if (m_size.minCoeff() <= 0)
+        throw NoriException("DensityGrid: \"%s\" has an invalid size!", filename);
+    size_t count = (size_t) m_size.x() * m_size.y() * m_size.z();
+    if (m_file->getSize() < sizeof(Header) + count * sizeof(float))
+        throw NoriException("DensityGrid: \"%s\" is truncated!", filename);
+
+    m_bounds = BoundingBox3f(Point3f(header.bounds[0], header.bounds[1], header.bounds[2]),
+                             Point3f(header.bounds[3], header.bounds[4], header.bounds[5]));
+    m_maxDensity = header.maxDensity;
+    m_data = reinterpret_cast<const float *>(static_cast<const char *>(m_file->getData()) + sizeof(Header));
+}
+
+void DensityGrid::loadText(const std::string &filename) {
+    std::ifstream is(filename);
+    if (!is.is_open())
+        throw NoriException("DensityGrid: unable to open \"%s\"!", filename);
+    m_file.reset();
+
+    int nx = 0, ny = 0, nz = 0;
+    is >> nx >> ny >> nz;
+    if (!is || nx <= 0 || ny <= 0 || nz <= 0)
+        throw NoriException("DensityGrid: \"%s\" has an invalid size!", filename);
+    m_size = Vector3i(nx, ny, nz);
+    m_values.resize((size_t) nx * ny * nz);
+    m_maxDensity = 0.f;
+    for (size_t i = 0; i < m_values.size(); ++i) {
+        if (!(is >> m_values[i]))
+            throw NoriException("DensityGrid: \"%s\" is truncated!", filename);
+        m_maxDensity = std::max(m_maxDensity, m_values[i]);
+    }
+    m_bounds = BoundingBox3f(Point3f(0.f), Point3f(1.f));
+    m_data = m_values.data();
+}
+
+void DensityGrid::save(const std::string &filename) const {
+    std::ofstream os(filename, std::ios::binary);
+    if (!os.is_open())
+        throw NoriException("DensityGrid: unable to write \"%s\"!", filename);
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, GridMagic, 4);
+    header.version = GridVersion;
+    header.dataType = EFloat32;
+    for (int i = 0; i < 3; ++i) {
+        header.size[i] = m_size[i];
+        header.bounds[i] = m_bounds.min[i];
+        header.bounds[i + 3] = m_bounds.max[i];
+    }
+    header.maxDensity = m_maxDensity;
+
+    os.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    os.write(reinterpret_cast<const char *>(m_data),
+             (std::streamsize) ((size_t) m_size.x() * m_size.y() * m_size.z() * sizeof(float)));
+    if (!os)
+        throw NoriException("DensityGrid: error while writing \"%s\"!", filename);
+}
+
+std::string DensityGrid::toString() const {
+    return tfm::format(
+        "DensityGrid[size = %ix%ix%i, bounds = %s, maxDensity = %f, %s]",
+        m_size.x(), m_size.y(), m_size.z(), m_bounds.toString(), m_maxDensity,
+        m_file ? "memory-mapped" : "in memory");
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,389 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/distributed.h>
+#include <nori/socket.h>
+#include <nori/render.h>
+#include <nori/scene.h>
+#include <nori/integrator.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <nori/sampler.h>
+#include <nori/timer.h>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+NORI_NAMESPACE_BEGIN
+
+/* =======================================================================
+     Wire protocol. Every message starts with a MessageHeader followed by
+     'size' bytes of payload. All values use the native byte order, hence
+     the coordinator and the workers must run on the same architecture.
+ * ======================================================================= */
+
+namespace {
+    enum EMessage : uint32_t {
+        EHello = 1,  ///< Worker -> coordinator: HelloMessage
+        EAccept,     ///< Coordinator -> worker: no payload
+        EReject,     ///< Coordinator -> worker: error string
+        ERequest,    ///< Worker -> coordinator: ask for a work unit
+        EAssign,     ///< Coordinator -> worker: WorkUnit
+        EResult,     ///< Worker -> coordinator: unit ID + block contents
+        EDone        ///< Coordinator -> worker: no work left
+    };
+
+    struct MessageHeader {
+        uint32_t type;
+        uint32_t size;
+    };
+
+    /// Sent by the workers so that the coordinator can detect mismatched scenes
+    struct HelloMessage {
+        int32_t width, height;
+        int32_t borderSize;
+        uint64_t sampleCount;
+
+        bool operator==(const HelloMessage &m) const {
+            return width == m.width && height == m.height &&
+                   borderSize == m.borderSize && sampleCount == m.sampleCount;
+        }
+    };
+
+    /// An image block and the range of pixel samples to be rendered into it
+    struct WorkUnit {
+        uint32_t id;
+        int32_t offsetX, offsetY;
+        int32_t sizeX, sizeY;
+        uint64_t sampleOffset;
+        uint64_t sampleCount;
+    };
+
+    bool sendMessage(Socket &socket, uint32_t type, const void *payload = nullptr, size_t size = 0) {
+        MessageHeader header { type, (uint32_t) size };
+        return socket.sendAll(&header, sizeof(MessageHeader)) &&
+               (size == 0 || socket.sendAll(payload, size));
+    }
+
+    /// Reject integrators that learn between passes, which workers never finish
+    void checkIntegrator(const Scene *scene) {
+        if (scene->getIntegrator()->requiresPasses())
+            throw NoriException("Distributed rendering does not support integrators "
+                                "that update their state between passes (e.g. path_guided)");
+    }
+
+    HelloMessage makeHello(const Scene *scene) {
+        const Camera *camera = scene->getCamera();
+        ImageBlock block(Vector2i(1), camera->getReconstructionFilter());
+        HelloMessage hello;
+        hello.width = camera->getOutputSize().x();
+        hello.height = camera->getOutputSize().y();
+        hello.borderSize = block.getBorderSize();
+        hello.sampleCount = (uint64_t) scene->getSampler()->getSampleCount();
+        return hello;
+    }
+
+    /// Size of the payload of an \c EResult message
+    size_t resultSize(const WorkUnit &unit, int borderSize) {
+        return sizeof(uint32_t) + sizeof(float) * 4 *
+            (size_t) (unit.sizeX + 2 * borderSize) * (size_t) (unit.sizeY + 2 * borderSize);
+    }
+
+    /**
+     * Thread-safe queue of the work units that have not been completed yet.
+     * A unit is removed by \ref acquire() and either marked as finished by
+     * \ref complete() or put back by \ref requeue() when its worker is lost.
+     */
+    class WorkQueue {
+    public:
+        void push(const WorkUnit &unit) {
+            m_pending.push_back(unit);
+            ++m_remaining;
+        }
+
+        /// Wait for a unit. Returns \c false once all units are complete.
+        bool acquire(WorkUnit &unit) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [&] { return !m_pending.empty() || m_remaining == 0; });
+            if (m_remaining == 0)
+                return false;
+            unit = m_pending.front();
+            m_pending.pop_front();
+            return true;
+        }
+
+        /// Mark a unit as finished after its worker spent \c duration milliseconds on it
+        void complete(double duration) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_maxDuration = std::max(m_maxDuration, duration);
+            if (--m_remaining == 0)
+                m_cond.notify_all();
+        }
+
+        /**
+         * \brief Time in milliseconds after which a worker that has not
+         * returned its unit is considered lost
+         *
+         * Workers whose host crashed or became unreachable never close their
+         * connection, so the coordinator cannot wait for them indefinitely.
+         * The limit adapts to the slowest unit that has been completed so far.
+         */
+        int unitTimeout() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return (int) std::min(std::max(MinUnitTimeout, 10 * m_maxDuration), (double) INT_MAX);
+        }
+
+        void requeue(const WorkUnit &unit) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            /* Lost units go first, they are likely to be the last ones missing */
+            m_pending.push_front(unit);
+            m_cond.notify_one();
+        }
+
+        bool finished() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_remaining == 0;
+        }
+
+        size_t remaining() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_remaining;
+        }
+    private:
+        /// Lower bound of \ref unitTimeout() (5 minutes)
+        static constexpr double MinUnitTimeout = 5 * 60 * 1000;
+
+        std::deque<WorkUnit> m_pending;
+        size_t m_remaining = 0;
+        double m_maxDuration = 0;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cond;
+    };
+
+    /// Handle the connection to a single worker (runs in its own thread)
+    void serveWorker(Socket &socket, WorkQueue &queue, const Scene *scene,
+                     const HelloMessage &expected, ImageBlock &result) {
+        MessageHeader header;
+        HelloMessage hello;
+        if (!socket.recvAll(&header, sizeof(MessageHeader)) || header.type != EHello ||
+            header.size != sizeof(HelloMessage) || !socket.recvAll(&hello, sizeof(HelloMessage)))
+            return;
+
+        if (!(hello == expected)) {
+            std::string error = tfm::format(
+                "the worker's scene (%ix%i, %i spp) does not match the coordinator's scene (%ix%i, %i spp)",
+                hello.width, hello.height, hello.sampleCount,
+                expected.width, expected.height, expected.sampleCount);
+            cerr << "Rejected a worker: " << error << endl;
+            sendMessage(socket, EReject, error.data(), error.size());
+            return;
+        }
+        if (!sendMessage(socket, EAccept))
+            return;
+
+        ImageBlock block(Vector2i(NORI_BLOCK_SIZE), scene->getCamera()->getReconstructionFilter());
+        int border = block.getBorderSize();
+        std::vector<float> buffer;
+
+        while (true) {
+            if (!socket.recvAll(&header, sizeof(MessageHeader)) || header.type != ERequest)
+                return;
+
+            WorkUnit unit;
+            if (!queue.acquire(unit)) {
+                sendMessage(socket, EDone);
+                return;
+            }
+
+            /* From here on, the unit must be put back if anything goes wrong */
+            uint32_t id;
+            buffer.resize((resultSize(unit, border) - sizeof(uint32_t)) / sizeof(float));
+            Timer timer;
+            if (!sendMessage(socket, EAssign, &unit, sizeof(WorkUnit)) ||
+                !socket.recvAll(&header, sizeof(MessageHeader), queue.unitTimeout()) ||
+                header.type != EResult || header.size != resultSize(unit, border) ||
+                !socket.recvAll(&id, sizeof(uint32_t), queue.unitTimeout()) || id != unit.id ||
+                !socket.recvAll(buffer.data(), buffer.size() * sizeof(float), queue.unitTimeout())) {
+                cerr << "Lost the connection to a worker (or it timed out), reassigning block at ["
+                     << unit.offsetX << ", " << unit.offsetY << "]" << endl;
+                queue.requeue(unit);
+                return;
+            }
+
+            block.setOffset(Point2i(unit.offsetX, unit.offsetY));
+            block.setSize(Vector2i(unit.sizeX, unit.sizeY));
+            const float *ptr = buffer.data();
+            for (int y = 0; y < unit.sizeY + 2 * border; ++y) {
+                for (int x = 0; x < unit.sizeX + 2 * border; ++x) {
+                    block.coeffRef(y, x) = Color4f(ptr[0], ptr[1], ptr[2], ptr[3]);
+                    ptr += 4;
+                }
+            }
+            result.put(block);
+            queue.complete(timer.elapsed());
+        }
+    }
+
+    /// Worker thread: render units over a dedicated connection until the coordinator is done
+    void workerThread(const Scene *scene, const std::string &address) {
+        std::unique_ptr<Socket> socket = Socket::connect(address);
+
+        HelloMessage hello = makeHello(scene);
+        MessageHeader header;
+        if (!sendMessage(*socket, EHello, &hello, sizeof(HelloMessage)) ||
+            !socket->recvAll(&header, sizeof(MessageHeader)))
+            throw NoriException("Lost the connection to the coordinator");
+
+        if (header.type == EReject) {
+            std::string error(header.size, '\0');
+            socket->recvAll(&error[0], header.size);
+            throw NoriException("The coordinator rejected this worker: %s", error);
+        } else if (header.type != EAccept) {
+            throw NoriException("Unexpected message from the coordinator");
+        }
+
+        ImageBlock block(Vector2i(NORI_BLOCK_SIZE), scene->getCamera()->getReconstructionFilter());
+        std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+        int border = block.getBorderSize();
+        std::vector<float> buffer;
+
+        while (true) {
+            WorkUnit unit;
+            if (!sendMessage(*socket, ERequest) ||
+                !socket->recvAll(&header, sizeof(MessageHeader)))
+                throw NoriException("Lost the connection to the coordinator");
+            if (header.type == EDone)
+                break;
+            if (header.type != EAssign || header.size != sizeof(WorkUnit) ||
+                !socket->recvAll(&unit, sizeof(WorkUnit)))
+                throw NoriException("Unexpected message from the coordinator");
+
+            block.setOffset(Point2i(unit.offsetX, unit.offsetY));
+            block.setSize(Vector2i(unit.sizeX, unit.sizeY));
+            sampler->setSampleOffset((size_t) unit.sampleOffset);
+            sampler->prepare(block);
+            renderBlock(scene, sampler.get(), block, (size_t) unit.sampleCount);
+
+            buffer.clear();
+            for (int y = 0; y < unit.sizeY + 2 * border; ++y) {
+                for (int x = 0; x < unit.sizeX + 2 * border; ++x) {
+                    const Color4f &c = block.coeff(y, x);
+                    buffer.insert(buffer.end(), { c[0], c[1], c[2], c[3] });
+                }
+            }
+
+            MessageHeader resultHeader { EResult, (uint32_t) resultSize(unit, border) };
+            if (!socket->sendAll(&resultHeader, sizeof(MessageHeader)) ||
+                !socket->sendAll(&unit.id, sizeof(uint32_t)) ||
+                !socket->sendAll(buffer.data(), buffer.size() * sizeof(float)))
+                throw NoriException("Lost the connection to the coordinator");
+        }
+    }
+}
+
+void renderCoordinator(const Scene *scene, const std::string &address,
+                       ImageBlock &result, size_t samplesDone, size_t passSize) {
+    checkIntegrator(scene);
+
+    const Camera *camera = scene->getCamera();
+    Vector2i outputSize = camera->getOutputSize();
+    size_t sampleCount = scene->getSampler()->getSampleCount();
+
+    /* Split the remaining work into one unit per block and pass */
+    WorkQueue queue;
+    uint32_t unitCount = 0;
+    for (size_t offset = samplesDone; offset < sampleCount; offset += passSize) {
+        BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE,
+            camera->getCropOffset(), camera->getCropSize());
+        ImageBlock block(Vector2i(NORI_BLOCK_SIZE), nullptr);
+        while (blockGenerator.next(block)) {
+            WorkUnit unit;
+            unit.id = unitCount++;
+            unit.offsetX = block.getOffset().x();
+            unit.offsetY = block.getOffset().y();
+            unit.sizeX = block.getSize().x();
+            unit.sizeY = block.getSize().y();
+            unit.sampleOffset = (uint64_t) offset;
+            unit.sampleCount = (uint64_t) std::min(passSize, sampleCount - offset);
+            queue.push(unit);
+        }
+    }
+
+    HelloMessage expected = makeHello(scene);
+    std::unique_ptr<Socket> listener = Socket::listen(address);
+    cout << "Waiting for workers on \"" << address << "\" (" << unitCount << " work units) .. " << endl;
+
+    std::vector<std::shared_ptr<Socket>> connections;
+    std::vector<std::thread> threads;
+    std::atomic<int> activeConnections(0);
+    Timer progressTimer;
+
+    while (!queue.finished()) {
+        std::unique_ptr<Socket> connection = listener->accept(100);
+
+        if (connection) {
+            std::shared_ptr<Socket> socket(std::move(connection));
+            connections.push_back(socket);
+            ++activeConnections;
+            threads.emplace_back([socket, &queue, scene, &expected, &result, &activeConnections] {
+                serveWorker(*socket, queue, scene, expected, result);
+                socket->shutdown();
+                --activeConnections;
+            });
+        }
+
+        if (progressTimer.elapsed() > 10000) {
+            cout << "  " << (unitCount - queue.remaining()) << "/" << unitCount
+                 << " work units done" << endl;
+            progressTimer.reset();
+        }
+    }
+
+    /* Give the workers a moment to ask for more work (and to receive
+       EDone), then wake up the threads of workers that are unresponsive */
+    Timer shutdownTimer;
+    while (activeConnections > 0 && shutdownTimer.elapsed() < 5000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (auto &connection : connections)
+        connection->shutdown();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void runWorker(const Scene *scene, const std::string &address, int threadCount) {
+    checkIntegrator(scene);
+
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    cout << "Connecting " << threadCount << " worker thread(s) to \"" << address << "\" .. " << endl;
+
+    std::vector<std::thread> threads;
+    std::mutex errorMutex;
+    std::string error;
+    for (int i = 0; i < threadCount; ++i) {
+        threads.emplace_back([&] {
+            try {
+                workerThread(scene, address);
+            } catch (const std::exception &e) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (error.empty())
+                    error = e.what();
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    if (!error.empty())
+        throw NoriException("%s", error);
+    cout << "Worker done." << endl;
+}
+
+NORI_NAMESPACE_END
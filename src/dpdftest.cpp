@@ -0,0 +1,137 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/object.h>
+#include <nori/dpdf.h>
+#include <nori/timer.h>
+#include <hypothesis.h>
+#include <pcg32.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Microbenchmark of the discrete distributions
+ *
+ * Compares the sampling performance of the CDF-based \ref DiscretePDF
+ * against the alias table in \ref AliasDiscretePDF for distributions of
+ * different sizes. The entries are random and strongly skewed, similar to
+ * the triangle areas of a scanned mesh. For each size, the build and
+ * sampling times are reported, and a chi-square test checks that the
+ * alias table reproduces the distribution.
+ */
+class DiscretePDFTest : public NoriObject {
+public:
+    DiscretePDFTest(const PropertyList &propList) {
+        /* Distribution sizes that should be benchmarked */
+        std::vector<std::string> sizes = tokenize(propList.getString("sizes", "16, 1024, 65536, 1048576"));
+        for (auto size : sizes)
+            m_sizes.push_back((size_t) toInt(size));
+
+        /* Number of samples that are drawn from each distribution (default: 10M) */
+        m_sampleCount = propList.getInteger("sampleCount", 10000000);
+
+        /* Significance level of the chi-square test */
+        m_significanceLevel = propList.getFloat("significanceLevel", 0.01f);
+
+        /* Only run the chi-square test for distributions up to this size */
+        m_maxTestSize = (size_t) propList.getInteger("maxTestSize", 65536);
+    }
+
+    void activate() {
+        int total = 0, passed = 0;
+        int testCount = 0;
+        for (size_t size : m_sizes)
+            if (size <= m_maxTestSize)
+                ++testCount;
+
+        for (size_t size : m_sizes) {
+            cout << "------------------------------------------------------" << endl;
+            cout << "Distribution with " << size << " entries" << endl;
+
+            pcg32 random;
+            std::vector<float> weights(size);
+            for (size_t i = 0; i < size; ++i) {
+                float value = random.nextFloat();
+                weights[i] = value * value * value * value + 1e-4f;
+            }
+
+            Timer timer;
+            DiscretePDF cdf(size);
+            for (float weight : weights)
+                cdf.append(weight);
+            cdf.normalize();
+            double cdfBuild = timer.lap();
+
+            AliasDiscretePDF alias(size);
+            for (float weight : weights)
+                alias.append(weight);
+            alias.normalize();
+            double aliasBuild = timer.lap();
+
+            /* Sample with reuse, as done by the area lights. The checksum
+               keeps the compiler from optimizing the loops away */
+            size_t checksum = 0;
+            for (int i = 0; i < m_sampleCount; ++i) {
+                float sample = random.nextFloat();
+                checksum += cdf.sampleReuse(sample);
+            }
+            double cdfSample = timer.lap();
+
+            for (int i = 0; i < m_sampleCount; ++i) {
+                float sample = random.nextFloat();
+                checksum += alias.sampleReuse(sample);
+            }
+            double aliasSample = timer.lap();
+
+            cout << tfm::format("  build:  CDF %8.1f ms,  alias %8.1f ms", cdfBuild, aliasBuild) << endl;
+            cout << tfm::format("  sample: CDF %8.1f ns,  alias %8.1f ns  (%.1fx faster, checksum %i)",
+                1e6 * cdfSample / m_sampleCount, 1e6 * aliasSample / m_sampleCount,
+                aliasSample > 0 ? cdfSample / aliasSample : 0.0, checksum % 1000) << endl;
+
+            if (size > m_maxTestSize)
+                continue;
+
+            std::vector<double> obsFrequencies(size, 0.0), expFrequencies(size);
+            for (int i = 0; i < m_sampleCount; ++i)
+                obsFrequencies[alias.sample(random.nextFloat())] += 1;
+            for (size_t i = 0; i < size; ++i)
+                expFrequencies[i] = cdf[i] * m_sampleCount;
+
+            ++total;
+            std::pair<bool, std::string> result = hypothesis::chi2_test((int) size,
+                obsFrequencies.data(), expFrequencies.data(), m_sampleCount,
+                5, m_significanceLevel, testCount);
+            if (result.first)
+                ++passed;
+            cout << result.second << endl;
+        }
+
+        cout << "Passed " << passed << "/" << total << " tests." << endl;
+        if (passed < total)
+            throw std::runtime_error("Some tests failed :(");
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "DiscretePDFTest[\n"
+            "  sampleCount = %i,\n"
+            "  significanceLevel = %f\n"
+            "]",
+            m_sampleCount,
+            m_significanceLevel
+        );
+    }
+
+    EClassType getClassType() const { return ETest; }
+private:
+    std::vector<size_t> m_sizes;
+    int m_sampleCount;
+    float m_significanceLevel;
+    size_t m_maxTestSize;
+};
+
+NORI_REGISTER_CLASS(DiscretePDFTest, "dpdftest");
+NORI_NAMESPACE_END
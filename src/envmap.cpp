@@ -0,0 +1,179 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/emitter.h>
+#include <nori/scene.h>
+#include <nori/bitmap.h>
+#include <nori/dpdf.h>
+#include <nori/lowdiscrepancy.h>
+#include <nori/transform.h>
+#include <filesystem/resolver.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Environment emitter that illuminates the scene from all directions
+ *
+ * The radiance is read from a latitude-longitude HDR image (OpenEXR). The
+ * +Y axis of the emitter's local frame points up, and \c toWorld can be
+ * used to rotate the environment.
+ *
+ * Directions are importance sampled proportionally to the luminance of the
+ * pixels, weighted by the sine of the elevation to account for the area
+ * distortion of the parameterization. Rows are chosen from a marginal
+ * distribution and pixels from a conditional distribution per row. Both
+ * use alias tables, so a sample takes constant time regardless of the
+ * image resolution.
+ */
+class EnvironmentMap : public Emitter {
+public:
+    EnvironmentMap(const PropertyList &props) {
+        filesystem::path filename =
+            getFileResolver()->resolve(props.getString("filename"));
+        m_bitmap = Bitmap(filename.str());
+        if (m_bitmap.cols() == 0 || m_bitmap.rows() == 0)
+            throw NoriException("EnvironmentMap: \"%s\" is empty!", filename);
+
+        /* Scale factor of the radiance values */
+        m_scale = props.getFloat("scale", 1.f);
+
+        m_toWorld = props.getTransform("toWorld", Transform());
+        m_toLocal = m_toWorld.inverse();
+
+        int width = (int) m_bitmap.cols(), height = (int) m_bitmap.rows();
+        m_conditional.resize(height);
+        m_marginal = AliasDiscretePDF(height);
+        double radianceSum = 0.0;
+        for (int y = 0; y < height; ++y) {
+            float sinTheta = std::sin(M_PI * (y + 0.5f) / height);
+            AliasDiscretePDF &row = m_conditional[y];
+            row.reserve(width);
+            for (int x = 0; x < width; ++x) {
+                float luminance = std::max(0.f, m_bitmap(y, x).getLuminance());
+                row.append(luminance * sinTheta);
+                radianceSum += luminance * sinTheta;
+            }
+            m_marginal.append(row.normalize());
+        }
+        if (!(m_marginal.normalize() > 0))
+            throw NoriException("EnvironmentMap: \"%s\" does not emit any light!", filename);
+
+        /* Average luminance over the sphere */
+        m_averageLuminance = m_scale * (float) (radianceSum / ((double) width * height)) * 0.5f * M_PI;
+    }
+
+    void setParent(NoriObject *parent) override {
+        m_parent = parent;
+    }
+
+    void build() override {
+        /* Sampled positions are placed outside of the scene's bounding sphere */
+        const Scene *scene = dynamic_cast<const Scene *>(m_parent);
+        if (scene) {
+            const BoundingBox3f &bbox = scene->getBoundingBox();
+            m_sceneRadius = bbox.isValid() ? std::max((bbox.max - bbox.getCenter()).norm(), Epsilon) : 1.f;
+        }
+    }
+
+    bool isEnvironment() const override {
+        return true;
+    }
+
+    Color3f eval(const EmitterQueryRecord &eRec) const override {
+        Point2f uv = directionToUV(eRec.point - eRec.ref);
+        int x = std::min((int) (uv.x() * m_bitmap.cols()), (int) m_bitmap.cols() - 1);
+        int y = std::min((int) (uv.y() * m_bitmap.rows()), (int) m_bitmap.rows() - 1);
+        return m_bitmap(y, x) * m_scale;
+    }
+
+    Color3f sample(const Point3f &surfacePoint, EmitterQueryRecord &eRec, const Point2f &sample) const override {
+        /* Choose a row, then a pixel, and reuse the samples for the position within the pixel */
+        float sampleX = sample.x(), sampleY = sample.y();
+        size_t y = m_marginal.sampleReuse(sampleY);
+        size_t x = m_conditional[y].sampleReuse(sampleX);
+        Point2f uv((x + sampleX) / m_bitmap.cols(), (y + sampleY) / m_bitmap.rows());
+
+        Vector3f d = uvToDirection(uv);
+        eRec.ref = surfacePoint;
+        eRec.point = surfacePoint + 2 * m_sceneRadius * d;
+        eRec.normal = -d;
+        eRec.face = (uint32_t) -1;
+        eRec.measure = ESolidAngle;
+
+        float pdfValue = pdf(eRec);
+        if (pdfValue <= 0)
+            return Color3f(0.f);
+        return eval(eRec) / pdfValue;
+    }
+
+    float pdf(const EmitterQueryRecord &bRec) const override {
+        Vector3f d = bRec.point - bRec.ref;
+        Point2f uv = directionToUV(d);
+        float sinTheta = std::sin(M_PI * uv.y());
+        if (sinTheta <= 0)
+            return 0.f;
+        size_t x = std::min((size_t) (uv.x() * m_bitmap.cols()), (size_t) m_bitmap.cols() - 1);
+        size_t y = std::min((size_t) (uv.y() * m_bitmap.rows()), (size_t) m_bitmap.rows() - 1);
+        float pdfRow = m_marginal[y];
+        if (pdfRow <= 0)
+            return 0.f;
+
+        /* Density on the image, converted to solid angle */
+        float pdfUV = pdfRow * m_conditional[y][x] * m_bitmap.cols() * m_bitmap.rows();
+        float pdfSolidAngle = pdfUV / (2 * M_PI * M_PI * sinTheta);
+        if (bRec.measure == ESolidAngle)
+            return pdfSolidAngle;
+        float squaredDist = d.squaredNorm();
+        return squaredDist > 0 ? pdfSolidAngle * std::abs(bRec.normal.dot(d)) / (squaredDist * std::sqrt(squaredDist)) : 0.f;
+    }
+
+    /// Average radiance (luminance) over all directions
+    Color3f emission() const override {
+        return Color3f(m_averageLuminance);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "EnvironmentMap[\n"
+            "  size = %ix%i,\n"
+            "  scale = %f,\n"
+            "  toWorld = %s\n"
+            "]",
+            m_bitmap.cols(), m_bitmap.rows(), m_scale,
+            indent(m_toWorld.toString(), 12));
+    }
+
+private:
+    /// Map a world-space direction to latitude-longitude image coordinates
+    Point2f directionToUV(const Vector3f &d) const {
+        Vector3f local = (m_toLocal * d).normalized();
+        float phi = std::atan2(local.x(), -local.z());
+        if (phi < 0)
+            phi += 2 * M_PI;
+        float theta = std::acos(clamp(local.y(), -1.f, 1.f));
+        return Point2f(std::min(phi * INV_TWOPI, OneMinusEpsilon), std::min(theta * INV_PI, OneMinusEpsilon));
+    }
+
+    /// Map latitude-longitude image coordinates to a world-space direction
+    Vector3f uvToDirection(const Point2f &uv) const {
+        float phi = 2 * M_PI * uv.x(), theta = M_PI * uv.y();
+        float sinTheta = std::sin(theta);
+        Vector3f local(sinTheta * std::sin(phi), std::cos(theta), -sinTheta * std::cos(phi));
+        return (m_toWorld * local).normalized();
+    }
+
+    NoriObject *m_parent = nullptr;
+    Bitmap m_bitmap;
+    float m_scale;
+    Transform m_toWorld, m_toLocal;
+    AliasDiscretePDF m_marginal;
+    std::vector<AliasDiscretePDF> m_conditional;
+    float m_averageLuminance = 0.f;
+    float m_sceneRadius = 1.f;
+};
+
+NORI_REGISTER_CLASS(EnvironmentMap, "envmap");
+NORI_NAMESPACE_END
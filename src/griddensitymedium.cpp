@@ -2,12 +2,15 @@
 // Created by 郭彬 on 2022/3/31.
 //
 
-#include <fstream>
-
 #include <nori/medium.h>
 #include <nori/sampler.h>
 #include <nori/phasefunction.h>
 #include <nori/color.h>
+#include <nori/majorant.h>
+#include <nori/sparsegrid.h>
+#include <nori/dpdf.h>
+#include <filesystem/resolver.h>
+#include <Eigen/LU>
 
 NORI_NAMESPACE_BEGIN
 
@@ -19,13 +22,50 @@ public:
         sigma_s = propList.getColor("sigma_s", Color3f(0.2f));
         g = propList.getFloat("g", 0.1f);
         sigma_t = sigma_s + sigma_a;
-        if (sigma_t.x() != sigma_t.y() || sigma_t.x() != sigma_t.z()) {
-            std::cout << "GridDensityMedium requires a spectrally uniform attenuation \n";
-        }
+        /* Chromatic media share the majorant of the most attenuating channel */
+        sigma_max = sigma_t.maxCoeff();
 
         m_phase = std::make_shared<HenyeyGreenstein>(g);
-        worldToMedium = propList.getTransform("toWorld", Transform()).inverse();
-        readDensityFromFile(propList.getString("densityFile"));
+        filesystem::path filename =
+            getFileResolver()->resolve(propList.getString("densityFile"));
+        {
+            /* Only the sparse representation is kept in memory */
+            DensityGrid denseGrid;
+            denseGrid.load(filename.str());
+            grid.build(denseGrid);
+        }
+        Transform toWorld = propList.getTransform("toWorld", Transform());
+        worldToMedium = Transform(unitCubeTransform(grid.getBounds())) * toWorld.inverse();
+
+        /* Emitted radiance, optionally scaled by a grid (e.g. a fire simulation) */
+        emittance = propList.getColor("emittance", Color3f(0.f));
+        std::string emissionFile = propList.getString("emissionFile", "");
+        if (!emissionFile.empty()) {
+            DensityGrid denseGrid;
+            denseGrid.load(getFileResolver()->resolve(emissionFile).str());
+            emissionGrid.build(denseGrid);
+            worldToEmission = Transform(unitCubeTransform(emissionGrid.getBounds())) * toWorld.inverse();
+        }
+
+        /* Estimator used by tr(): "delta", "ratio" or "residualRatio" */
+        std::string estimatorName = propList.getString("transmittance", "residualRatio");
+        if (estimatorName == "delta")
+            estimator = EDeltaTracking;
+        else if (estimatorName == "ratio")
+            estimator = ERatioTracking;
+        else if (estimatorName == "residualRatio")
+            estimator = EResidualRatioTracking;
+        else
+            throw NoriException("GridDensityMedium: unknown transmittance estimator \"%s\"", estimatorName);
+
+        /* Free-flight sampling uses the per-cell maxima of a coarse grid */
+        int majorantResolution = propList.getInteger("majorantResolution", 16);
+        majorants.build(grid.getSize(), [&](int x, int y, int z) {
+            return grid(x, y, z);
+        }, majorantResolution);
+
+        if (!emissionFile.empty() && !emittance.isZero())
+            buildEmissionDistribution();
     }
 
     Color3f tr(const Ray3f &ray, Sampler *sampler) const override {
@@ -36,25 +76,48 @@ public:
         tMin = std::max(tMin, localRay.mint);
         tMax = std::min(tMax, localRay.maxt);
 
-        float t = tMin;
-        float tr = 1;
-        while (true) {
-            t -= std::log(1.f - sampler->next1D()) * invMaxDensity / sigma_t[0];
-            if (t >= tMax) break;
-            float den = density(localRay(t));
-            tr *= 1.f - std::max(0.f, den * invMaxDensity);
-            const float rrThreshold = .1f;
-            if (tr < rrThreshold) {
-                float q = std::max(.05f, 1.f - tr);
-                if (sampler->next1D() < q) return Color3f(0);
-                tr /= 1 - q;
-            }
+        Color3f tr(1.f);
+        if (estimator == EDeltaTracking) {
+            /* Binary estimate per channel: did the ray pass without a real collision? */
+            deltaTrack(localRay, tMin, tMax, sampler, false, [&](float t, float majorant, float) {
+                Color3f real = density(localRay(t)) * sigma_t;
+                float u = majorant * sigma_max * sampler->next1D();
+                for (int i = 0; i < 3; ++i)
+                    if (real[i] > u)
+                        tr[i] = 0.f;
+                return !tr.isZero();
+            });
+        } else {
+            /* Ratio tracking multiplies the probabilities of null collisions. Residual ratio
+               tracking only tracks the difference to the minorant of each cell, whose
+               transmittance is computed analytically */
+            bool residual = estimator == EResidualRatioTracking;
+            float controlDepth = 0;
+            deltaTrack(localRay, tMin, tMax, sampler, residual, [&](float t, float majorant, float minorant) {
+                float den = density(localRay(t)) - minorant;
+                Color3f real = den * sigma_t / (majorant * sigma_max);
+                tr *= Color3f(1.f) - real.min(1.f).max(0.f);
+                const float rrThreshold = .1f;
+                float trTotal = tr.maxCoeff() * std::exp(-controlDepth * sigma_t.minCoeff());
+                if (trTotal < rrThreshold) {
+                    float q = std::max(.05f, 1.f - trTotal);
+                    if (sampler->next1D() < q) {
+                        tr = 0;
+                        return false;
+                    }
+                    tr /= 1 - q;
+                }
+                return true;
+            }, &controlDepth);
+            Color3f controlTr = -controlDepth * sigma_t;
+            tr *= controlTr.exp();
         }
 
-        return Color3f(tr);
+        return tr;
     }
 
-    Color3f sample(const Ray3f &ray, Sampler *sampler, Intersection &its) const override {
+    Color3f sample(const Ray3f &ray, Sampler *sampler, Intersection &its,
+                   const Color3f &throughput) const override {
         Ray3f localRay = worldToMedium * ray;
         const BoundingBox3f b(Point3f(0, 0, 0), Point3f(1, 1, 1));
         float tMin, tMax;
@@ -62,19 +125,37 @@ public:
         tMin = std::max(tMin, localRay.mint);
         tMax = std::min(tMax, localRay.maxt);
 
-        float t = tMin;
-        while (true) {
-            t -= std::log(1.f - sampler->next1D()) * invMaxDensity / sigma_t[0];
-            if (t >= tMax) break;
-            if (density(localRay(t)) * invMaxDensity > sampler->next1D()) {
-                its.mediumInterface = this;
-                its.insideMedium = true;
-                its.t = t;
-                return Color3f(1.f / sigma_t[0]);
+        /* Track with the shared majorant using the collision probabilities of one
+           channel, and weight the result with the balance heuristic over all
+           channels. Since the majorant is shared, the exponential terms of the
+           path densities cancel and only the products of the null-collision
+           probabilities of each channel (nullProb) are needed */
+        Color3f channelPdfs = channelPdf(throughput);
+        int channel = sampleChannel(channelPdfs, sampler->next1D());
+        Color3f nullProb(1.f);
+        float tCollision = 0;
+        bool scattered = !deltaTrack(localRay, tMin, tMax, sampler, false, [&](float t, float majorant, float) {
+            Color3f real = density(localRay(t)) * sigma_t / (majorant * sigma_max);
+            real = real.min(1.f).max(0.f);
+            if (sampler->next1D() < real[channel]) {
+                tCollision = t;
+                return false;
             }
+            nullProb *= Color3f(1.f) - real;
+            /* Only the ratios between the channels matter */
+            float scale = nullProb.maxCoeff();
+            if (scale < 1e-8f)
+                nullProb /= scale;
+            return true;
+        });
+        if (scattered) {
+            its.mediumInterface = this;
+            its.insideMedium = true;
+            its.t = tCollision;
+            return (Color3f) (nullProb / (channelPdfs * nullProb * sigma_t).sum());
         }
 
-        return Color3f(1);
+        return (Color3f) (nullProb / (channelPdfs * nullProb).sum());
     }
 
     Color3f sigmaA() const override {
@@ -85,56 +166,194 @@ public:
         return sigma_s;
     }
 
+    Color3f getEmittance(const Point3f &point, const Vector3f &w) const override {
+        if (emissionGrid.getSize().x() == 0)
+            return emittance;
+        return emittance * emissionGrid.lookup(worldToEmission * point);
+    }
+
+    bool isEmitter() const override {
+        return emissionPdf.size() > 0;
+    }
+
+    Color3f sampleEmission(const Point3f &sample, Point3f &p, float &pdf) const override {
+        if (emissionPdf.size() == 0) {
+            pdf = 0.f;
+            return Color3f(0.f);
+        }
+
+        /* Pick a voxel, and a uniformly distributed point within it */
+        float u = sample.x();
+        size_t entry = emissionPdf.sampleReuse(u, pdf);
+        const Vector3i &size = emissionGrid.getSize();
+        uint32_t index = emissiveVoxels[entry];
+        Point3f voxel(index % size.x(), (index / size.x()) % size.y(), index / (size.x() * size.y()));
+        Point3f local = (voxel + Vector3f(u, sample.y(), sample.z())).cwiseQuotient(size.cast<float>());
+        p = worldToEmission.inverse() * local;
+        pdf /= voxelVolume;
+
+        return sigma_a * density(worldToMedium * p) * getEmittance(p, Vector3f(0.f));
+    }
+
+    float pdfEmission(const Point3f &p) const override {
+        if (emissionPdf.size() == 0)
+            return 0.f;
+        Point3f local = worldToEmission * p;
+        const Vector3i &size = emissionGrid.getSize();
+        Point3i voxel;
+        for (int i = 0; i < 3; ++i) {
+            voxel[i] = (int) std::floor(local[i] * size[i]);
+            if (voxel[i] < 0 || voxel[i] >= size[i])
+                return 0.f;
+        }
+        uint32_t index = (uint32_t) ((voxel.z() * size.y() + voxel.y()) * size.x() + voxel.x());
+        auto it = std::lower_bound(emissiveVoxels.begin(), emissiveVoxels.end(), index);
+        if (it == emissiveVoxels.end() || *it != index)
+            return 0.f;
+        return emissionPdf[it - emissiveVoxels.begin()] / voxelVolume;
+    }
+
     std::string toString() const override {
-        return tfm::format("GridDensityMedium, sigma_a:%s, sigma_s:%s, g:%s \n", sigma_a, sigma_s, g);
+        return tfm::format("GridDensityMedium, sigma_a:%s, sigma_s:%s, g:%s, grid:%s, emissive voxels:%i \n",
+                           sigma_a, sigma_s, g, grid.toString(), emissiveVoxels.size());
     }
 
 private:
+    enum ETransmittanceEstimator {
+        EDeltaTracking,
+        ERatioTracking,
+        EResidualRatioTracking
+    };
+
     Color3f sigma_a, sigma_s, sigma_t;
+    float sigma_max;
+    Color3f emittance;
+    ETransmittanceEstimator estimator;
     float g;
-    float invMaxDensity;
-    int nx, ny, nz;
-    std::vector<float> densityData;
+    SparseGrid grid;
+    MajorantGrid majorants;
     Transform worldToMedium;
 
-    float density(const Point3f &p) const {
-        // Compute voxel coordinates and offsets for _p_
-        Point3f pSamples(p.x() * nx - .5f, p.y() * ny - .5f, p.z() * nz - .5f);
-        Point3i pi(floor(pSamples.x()), floor(pSamples.y()), floor(pSamples.z()));
-        Vector3f d(pSamples.x() - pi.x(), pSamples.y() - pi.y(), pSamples.z() - pi.z());
-
-        // Trilinearly interpolate density values to compute local density
-        float d00 = lerp(d.x(), D(pi), D(pi + Vector3i(1, 0, 0)));
-        float d10 = lerp(d.x(), D(pi + Vector3i(0, 1, 0)), D(pi + Vector3i(1, 1, 0)));
-        float d01 = lerp(d.x(), D(pi + Vector3i(0, 0, 1)), D(pi + Vector3i(1, 0, 1)));
-        float d11 = lerp(d.x(), D(pi + Vector3i(0, 1, 1)), D(pi + Vector3i(1, 1, 1)));
-        float d0 = lerp(d.y(), d00, d10);
-        float d1 = lerp(d.y(), d01, d11);
-        return lerp(d.z(), d0, d1);
-    }
+    /* Emission grid, and the distribution of sampleEmission() over its voxels */
+    SparseGrid emissionGrid;
+    Transform worldToEmission;
+    std::vector<uint32_t> emissiveVoxels;
+    AliasDiscretePDF emissionPdf;
+    float voxelVolume = 0.f;
 
-    float D(const Point3i &p) const {
-        BoundingBox3i sampleBounds(Point3i(0, 0, 0), Point3i(nx, ny, nz));
-        if (!sampleBounds.contains(p, true)) return 0;
-        return densityData[(p.z() * ny + p.y()) * nx + p.x()];
+    /// Return the matrix that maps a bounding box to the unit cube
+    static Eigen::Matrix4f unitCubeTransform(const BoundingBox3f &bounds) {
+        Vector3f scale = bounds.getExtents().cwiseInverse();
+        Eigen::Matrix4f gridToUnit = Eigen::Matrix4f::Identity();
+        for (int i = 0; i < 3; ++i) {
+            gridToUnit(i, i) = scale[i];
+            gridToUnit(i, 3) = -bounds.min[i] * scale[i];
+        }
+        return gridToUnit;
     }
 
-    void readDensityFromFile(const std::string &fileName) {
-        auto name = tfm::format("%s/%s", std::filesystem::current_path().string(), fileName);
-        std::fstream f(name);
-        if (!f.is_open()) {
-            std::cout << tfm::format("readDensityFromFile %s failed \n", fileName);
-            return;
+    /**
+     * Build the distribution of emission samples over the voxels of the
+     * emission grid. The weight of a voxel bounds the emitted power within
+     * it: the largest emission of the voxels that trilinear interpolation
+     * blends within it, times the largest density within it. Every point
+     * that emits light can therefore be sampled.
+     */
+    void buildEmissionDistribution() {
+        const Vector3i &size = emissionGrid.getSize();
+        const Vector3i &densitySize = grid.getSize();
+        const BoundingBox3f &emissionBounds = emissionGrid.getBounds(), &densityBounds = grid.getBounds();
+
+        for (int z = 0; z < size.z(); ++z) {
+            for (int y = 0; y < size.y(); ++y) {
+                for (int x = 0; x < size.x(); ++x) {
+                    Point3i voxel(x, y, z), lo, hi, densityLo, densityHi;
+                    bool empty = false;
+                    for (int i = 0; i < 3; ++i) {
+                        lo[i] = std::max(voxel[i] - 1, 0);
+                        hi[i] = std::min(voxel[i] + 1, size[i] - 1);
+
+                        /* Density voxels that contribute to lookups within the voxel */
+                        float extent = emissionBounds.getExtents()[i] / size[i];
+                        float min = (emissionBounds.min[i] + voxel[i] * extent - densityBounds.min[i])
+                            / densityBounds.getExtents()[i] * densitySize[i];
+                        float max = min + extent / densityBounds.getExtents()[i] * densitySize[i];
+                        densityLo[i] = std::max((int) std::floor(min - .5f), 0);
+                        densityHi[i] = std::min((int) std::floor(max - .5f) + 1, densitySize[i] - 1);
+                        empty |= densityLo[i] > densityHi[i];
+                    }
+                    if (empty)
+                        continue;
+
+                    float emission = 0.f, maxDensity = 0.f;
+                    for (int vz = lo.z(); vz <= hi.z(); ++vz)
+                        for (int vy = lo.y(); vy <= hi.y(); ++vy)
+                            for (int vx = lo.x(); vx <= hi.x(); ++vx)
+                                emission = std::max(emission, emissionGrid(vx, vy, vz));
+                    if (emission <= 0)
+                        continue;
+                    for (int vz = densityLo.z(); vz <= densityHi.z(); ++vz)
+                        for (int vy = densityLo.y(); vy <= densityHi.y(); ++vy)
+                            for (int vx = densityLo.x(); vx <= densityHi.x(); ++vx)
+                                maxDensity = std::max(maxDensity, grid(vx, vy, vz));
+                    if (maxDensity <= 0)
+                        continue;
+
+                    emissiveVoxels.push_back((uint32_t) ((z * size.y() + y) * size.x() + x));
+                    emissionPdf.append(emission * maxDensity);
+                }
+            }
         }
+        emissionPdf.normalize();
 
-        float maxDensity = 0;
-        f >> nx >> ny >> nz;
-        densityData.resize(nx * ny * nz);
-        for (size_t i = 0; i < densityData.size(); ++i) {
-            f >> densityData[i];
-            maxDensity = std::max(maxDensity, densityData[i]);
+        /* Volume of a voxel in world space */
+        Eigen::Matrix4f emissionToWorld = worldToEmission.inverse().getMatrix();
+        voxelVolume = std::abs(emissionToWorld.topLeftCorner<3, 3>().determinant())
+            / ((float) size.x() * size.y() * size.z());
+    }
+
+    /**
+     * Delta tracking through the cells of the majorant grid. Calls
+     * collision(t, majorant, minorant) at every tentative collision, which
+     * returns false to stop. Returns true if the end of the segment was reached.
+     *
+     * Collisions are sampled with the majorant density times sigma_max.
+     * When residual is set, collisions are sampled with the difference of
+     * the majorant and the minorant of each cell (the callback receives
+     * this difference as majorant), and the integral of the minorant
+     * density (without the extinction coefficient) is added to controlDepth.
+     */
+    template <typename Func>
+    bool deltaTrack(const Ray3f &localRay, float tMin, float tMax, Sampler *sampler, bool residual,
+                    const Func &collision, float *controlDepth = nullptr) const {
+        MajorantGrid::Iterator it(majorants, localRay, tMin, tMax);
+        float t0, t1, majorant, minorant;
+        float tau = -std::log(1.f - sampler->next1D());
+        while (it.next(t0, t1, majorant, minorant)) {
+            if (residual) {
+                *controlDepth += minorant * (t1 - t0);
+                majorant -= minorant;
+            } else {
+                minorant = 0;
+            }
+            float sigmaMaj = majorant * sigma_max;
+            if (sigmaMaj <= 0) continue;
+            while (true) {
+                float dt = tau / sigmaMaj;
+                if (t0 + dt >= t1) {
+                    tau -= sigmaMaj * (t1 - t0);
+                    break;
+                }
+                t0 += dt;
+                if (!collision(t0, majorant, minorant)) return false;
+                tau = -std::log(1.f - sampler->next1D());
+            }
         }
-        invMaxDensity = 1.f / maxDensity;
+        return true;
+    }
+
+    float density(const Point3f &p) const {
+        return grid.lookup(p);
     }
 };
 
@@ -0,0 +1,120 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/object.h>
+#include <nori/sparsegrid.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <pcg32.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Microbenchmark of the trilinear density lookups of \ref SparseGrid
+ *
+ * Compares the padded lookup kernel against the previous implementation of \c GridDensityMedium, which fetched every
+ * corner separately after testing it against the bounds of the grid. The
+ * points are uniformly distributed over a box slightly larger than the unit
+ * cube, so that lookups near and outside of the border are covered. The
+ * test fails if the kernel disagrees with the reference.
+ */
+class GridLookupTest : public NoriObject {
+public:
+    GridLookupTest(const PropertyList &propList) {
+        /* Density grid that should be benchmarked */
+        m_filename = getFileResolver()->resolve(propList.getString("densityFile")).str();
+
+        /* Number of lookups per implementation (default: 10M) */
+        m_lookupCount = propList.getInteger("lookupCount", 10000000);
+    }
+
+    void activate() {
+        Timer timer;
+        {
+            DensityGrid denseGrid;
+            denseGrid.load(m_filename);
+            m_grid.build(denseGrid);
+        }
+        cout << "Loaded " << m_grid.toString() << " (took " << timer.elapsedString() << ")" << endl;
+
+        pcg32 random;
+        std::vector<Point3f> points(m_lookupCount);
+        for (Point3f &p : points)
+            p = Point3f(random.nextFloat(), random.nextFloat(), random.nextFloat()) * 1.1f
+                - Vector3f::Constant(.05f);
+        std::vector<float> reference(m_lookupCount), single(m_lookupCount);
+
+        timer.reset();
+        for (int i = 0; i < m_lookupCount; ++i)
+            reference[i] = referenceLookup(points[i]);
+        double referenceTime = timer.lap();
+
+        for (int i = 0; i < m_lookupCount; ++i)
+            single[i] = m_grid.lookup(points[i]);
+        double singleTime = timer.lap();
+
+        float singleError = 0.f;
+        for (int i = 0; i < m_lookupCount; ++i)
+            singleError = std::max(singleError, std::abs(single[i] - reference[i]));
+
+        cout << tfm::format("  reference: %6.1f ns/lookup", 1e6 * referenceTime / m_lookupCount) << endl;
+        cout << tfm::format("  padded:    %6.1f ns/lookup  (%.1fx faster, max. error %g)",
+            1e6 * singleTime / m_lookupCount, singleTime > 0 ? referenceTime / singleTime : 0.0,
+            singleError) << endl;
+
+        /* The kernel interpolates in a different order than the reference */
+        float tolerance = 1e-5f * std::max(1.f, m_grid.getMaxDensity());
+        if (singleError > tolerance)
+            throw std::runtime_error("The lookup kernel does not match the reference :(");
+        cout << "Passed." << endl;
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "GridLookupTest[\n"
+            "  densityFile = \"%s\",\n"
+            "  lookupCount = %i\n"
+            "]",
+            m_filename,
+            m_lookupCount
+        );
+    }
+
+    EClassType getClassType() const { return ETest; }
+private:
+    /**
+     * Previous lookup of GridDensityMedium, which tests every corner against
+     * the bounds. (It used a strict test, which also dropped the first voxel
+     * along each axis. The reference includes those voxels.)
+     */
+    float referenceLookup(const Point3f &p) const {
+        const Vector3i &size = m_grid.getSize();
+        Point3f pSamples(p.x() * size.x() - .5f, p.y() * size.y() - .5f, p.z() * size.z() - .5f);
+        Point3i pi(std::floor(pSamples.x()), std::floor(pSamples.y()), std::floor(pSamples.z()));
+        Vector3f d = pSamples - pi.cast<float>();
+
+        float d00 = lerp(d.x(), D(pi), D(pi + Vector3i(1, 0, 0)));
+        float d10 = lerp(d.x(), D(pi + Vector3i(0, 1, 0)), D(pi + Vector3i(1, 1, 0)));
+        float d01 = lerp(d.x(), D(pi + Vector3i(0, 0, 1)), D(pi + Vector3i(1, 0, 1)));
+        float d11 = lerp(d.x(), D(pi + Vector3i(0, 1, 1)), D(pi + Vector3i(1, 1, 1)));
+        float d0 = lerp(d.y(), d00, d10);
+        float d1 = lerp(d.y(), d01, d11);
+        return lerp(d.z(), d0, d1);
+    }
+
+    float D(const Point3i &p) const {
+        BoundingBox3i sampleBounds(Point3i(0, 0, 0), m_grid.getSize() - Vector3i::Constant(1));
+        if (!sampleBounds.contains(p)) return 0;
+        return m_grid(p.x(), p.y(), p.z());
+    }
+
+    std::string m_filename;
+    int m_lookupCount;
+    SparseGrid m_grid;
+};
+
+NORI_REGISTER_CLASS(GridLookupTest, "gridlookuptest");
+NORI_NAMESPACE_END
@@ -0,0 +1,644 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+#include <nori/emitter.h>
+#include <nori/mesh.h>
+#include <nori/lowdiscrepancy.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Radiance is accumulated in fixed point: integer addition is associative,
+ * hence the learned distributions (and the rendered image) do not depend
+ * on the order in which the threads record their samples
+ */
+static const double FixedPointScale = 1 << 20;
+/// Largest value that may be recorded at once, so that the sums cannot overflow
+static const float MaxRecordedValue = 1e6f;
+
+static inline uint64_t toFixedPoint(float value) {
+    return (uint64_t) (std::min(value, MaxRecordedValue) * FixedPointScale + 0.5);
+}
+
+static inline float fromFixedPoint(uint64_t value) {
+    return (float) (value / FixedPointScale);
+}
+
+/// Map a direction to the unit square using the (area-preserving) cylindrical mapping
+static Point2f directionToCanonical(const Vector3f &d) {
+    float cosTheta = clamp(d.z(), -1.f, 1.f);
+    float phi = std::atan2(d.y(), d.x());
+    if (phi < 0)
+        phi += 2 * M_PI;
+    return Point2f(std::min(0.5f * (cosTheta + 1.f), OneMinusEpsilon),
+                   std::min(phi * INV_TWOPI, OneMinusEpsilon));
+}
+
+/// Inverse of \ref directionToCanonical()
+static Vector3f canonicalToDirection(const Point2f &p) {
+    float cosTheta = 2.f * p.x() - 1.f;
+    float sinTheta = std::sqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+    float phi = 2.f * M_PI * p.y();
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+/**
+ * \brief Quadtree that stores the incident radiance at a region of space
+ *
+ * The quadtree subdivides the unit square, which is mapped to the sphere of
+ * directions by \ref canonicalToDirection(). Since this mapping preserves
+ * areas, a density on the square turns into a solid angle density by
+ * dividing it by \f$4\pi\f$.
+ *
+ * Every node stores the radiance that was recorded in each of its four
+ * quadrants. While rendering, samples are only added to the leaves, and
+ * \ref build() propagates the sums up to the root afterwards. The sums
+ * are kept in fixed point, so that training is deterministic.
+ */
+class DTree {
+public:
+    DTree() : m_sampleCount(0) { m_nodes.emplace_back(); }
+
+    DTree(const DTree &tree)
+        : m_nodes(tree.m_nodes), m_sampleCount(tree.getSampleCount()), m_total(tree.m_total) { }
+
+    DTree &operator=(const DTree &tree) {
+        m_nodes = tree.m_nodes;
+        m_sampleCount.store(tree.getSampleCount(), std::memory_order_relaxed);
+        m_total = tree.m_total;
+        return *this;
+    }
+
+    /// Return the number of samples recorded since the last \ref refine()
+    uint32_t getSampleCount() const { return m_sampleCount.load(std::memory_order_relaxed); }
+
+    void setSampleCount(uint32_t count) { m_sampleCount.store(count, std::memory_order_relaxed); }
+
+    /// Return the number of nodes
+    size_t getNodeCount() const { return m_nodes.size(); }
+
+    /// Can this tree be used for sampling?
+    bool isValid() const { return m_total > 0; }
+
+    /// Record the radiance arriving from a direction (thread-safe)
+    void record(Point2f p, float value) {
+        m_sampleCount.fetch_add(1, std::memory_order_relaxed);
+        if (!std::isfinite(value) || value <= 0)
+            return;
+        uint32_t index = 0;
+        while (true) {
+            Node &node = m_nodes[index];
+            int q = Node::quadrant(p);
+            if (!node.children[q]) {
+                node.sum[q].fetch_add(toFixedPoint(value), std::memory_order_relaxed);
+                return;
+            }
+            index = node.children[q];
+        }
+    }
+
+    /// Propagate the sums of the leaves up to the root
+    void build() {
+        /* Children always have larger indices than their parents */
+        for (size_t i = m_nodes.size(); i-- > 0; ) {
+            Node &node = m_nodes[i];
+            for (int q = 0; q < 4; ++q)
+                if (node.children[q])
+                    node.sum[q].store(m_nodes[node.children[q]].getFixedTotal(), std::memory_order_relaxed);
+        }
+        m_total = fromFixedPoint(m_nodes[0].getFixedTotal());
+    }
+
+    /**
+     * \brief Reset the tree to an empty tree whose structure adapts to the
+     * radiance that was recorded in \c tree
+     *
+     * Quadrants that received more than the fraction \c threshold of the
+     * total radiance are subdivided (up to a depth of \c maxDepth), all other
+     * quadrants become leaves.
+     */
+    void refine(const DTree &tree, float threshold, int maxDepth) {
+        m_nodes.clear();
+        m_nodes.emplace_back();
+        m_sampleCount.store(0, std::memory_order_relaxed);
+        m_total = 0.f;
+        if (!tree.isValid())
+            return;
+
+        struct Entry {
+            uint32_t index;
+            /// Corresponding node of \c tree, or -1 if it is subdivided further than \c tree
+            uint32_t oldIndex;
+            /// Fraction of the total radiance within the node
+            float fraction;
+            int depth;
+        };
+
+        std::vector<Entry> stack;
+        stack.push_back(Entry { 0, 0, 1.f, 1 });
+        while (!stack.empty()) {
+            Entry entry = stack.back();
+            stack.pop_back();
+
+            for (int q = 0; q < 4; ++q) {
+                uint32_t oldChild = (uint32_t) -1;
+                /* Without finer information, assume that the radiance is uniform */
+                float fraction = 0.25f * entry.fraction;
+                if (entry.oldIndex != (uint32_t) -1) {
+                    const Node &old = tree.m_nodes[entry.oldIndex];
+                    fraction = old.getSum(q) / tree.m_total;
+                    if (old.children[q])
+                        oldChild = old.children[q];
+                }
+                if (entry.depth >= maxDepth || fraction <= threshold)
+                    continue;
+
+                uint32_t child = (uint32_t) m_nodes.size();
+                m_nodes.emplace_back();
+                m_nodes[entry.index].children[q] = child;
+                stack.push_back(Entry { child, oldChild, fraction, entry.depth + 1 });
+            }
+        }
+    }
+
+    /// Sample a point on the unit square proportionally to the recorded radiance
+    Point2f sample(Point2f sample) const {
+        uint32_t index = 0;
+        Point2f origin(0.f, 0.f);
+        float size = 1.f;
+        while (true) {
+            const Node &node = m_nodes[index];
+            float sum[4];
+            for (int q = 0; q < 4; ++q)
+                sum[q] = node.getSum(q);
+
+            /* Choose the column, then the row of the quadrant */
+            float left = sum[0] + sum[2], right = sum[1] + sum[3];
+            if (left + right <= 0)
+                break;
+            int q = 0;
+            float pLeft = left / (left + right);
+            if (sample.x() < pLeft) {
+                sample.x() /= pLeft;
+            } else {
+                sample.x() = (sample.x() - pLeft) / (1.f - pLeft);
+                q |= 1;
+            }
+            float top = sum[q], bottom = sum[q | 2];
+            float pTop = top / (top + bottom);
+            if (sample.y() < pTop) {
+                sample.y() /= pTop;
+            } else {
+                sample.y() = (sample.y() - pTop) / (1.f - pTop);
+                q |= 2;
+            }
+            sample = Point2f(std::min(sample.x(), OneMinusEpsilon), std::min(sample.y(), OneMinusEpsilon));
+
+            size *= 0.5f;
+            origin += Vector2f((q & 1) ? size : 0.f, (q & 2) ? size : 0.f);
+            if (!node.children[q])
+                break;
+            index = node.children[q];
+        }
+        Point2f p = origin + sample * size;
+        return Point2f(std::min(p.x(), OneMinusEpsilon), std::min(p.y(), OneMinusEpsilon));
+    }
+
+    /// Density of \ref sample() with respect to the area of the unit square
+    float pdf(Point2f p) const {
+        if (!isValid())
+            return 0.f;
+        float pdf = 1.f;
+        uint32_t index = 0;
+        while (true) {
+            const Node &node = m_nodes[index];
+            float total = fromFixedPoint(node.getFixedTotal());
+            if (total <= 0)
+                return 0.f;
+            int q = Node::quadrant(p);
+            pdf *= 4.f * node.getSum(q) / total;
+            if (!node.children[q])
+                return pdf;
+            index = node.children[q];
+        }
+    }
+
+private:
+    struct Node {
+        Node() {
+            for (int q = 0; q < 4; ++q) {
+                sum[q].store(0, std::memory_order_relaxed);
+                children[q] = 0;
+            }
+        }
+
+        Node(const Node &node) { *this = node; }
+
+        Node &operator=(const Node &node) {
+            for (int q = 0; q < 4; ++q) {
+                sum[q].store(node.sum[q].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                children[q] = node.children[q];
+            }
+            return *this;
+        }
+
+        /// Radiance recorded in a quadrant
+        float getSum(int q) const { return fromFixedPoint(sum[q].load(std::memory_order_relaxed)); }
+
+        uint64_t getFixedTotal() const {
+            uint64_t total = 0;
+            for (int q = 0; q < 4; ++q)
+                total += sum[q].load(std::memory_order_relaxed);
+            return total;
+        }
+
+        /**
+         * \brief Return the quadrant that contains \c p (bit 0: right half,
+         * bit 1: bottom half) and map \c p to the quadrant's unit square
+         */
+        static int quadrant(Point2f &p) {
+            int q = 0;
+            for (int i = 0; i < 2; ++i) {
+                p[i] *= 2.f;
+                if (p[i] >= 1.f) {
+                    p[i] = std::min(p[i] - 1.f, OneMinusEpsilon);
+                    q |= 1 << i;
+                }
+            }
+            return q;
+        }
+
+        /// Recorded radiance of every quadrant (in fixed point)
+        std::atomic<uint64_t> sum[4];
+        /// Index of the child node of every quadrant (zero for leaves)
+        uint32_t children[4];
+    };
+
+    std::vector<Node> m_nodes;
+    std::atomic<uint32_t> m_sampleCount;
+    float m_total = 0.f;
+};
+
+/**
+ * \brief Spatial binary tree whose leaves store directional quadtrees
+ * (the "SD-tree" of Müller et al., "Practical Path Guiding for Efficient
+ * Light-Transport Simulation", 2017)
+ *
+ * Every node splits its cell in the middle, cycling through the X, Y and Z
+ * axes. Each leaf holds two quadtrees: one that is used for sampling during
+ * the current pass, and one that records the radiance for the next pass.
+ */
+class SDTree {
+public:
+    /// Quadtrees of a leaf of the spatial tree
+    struct Leaf {
+        DTree sampling;
+        DTree building;
+    };
+
+    /// Reset the tree to a single leaf that covers the given box
+    void clear(const BoundingBox3f &bbox) {
+        /* Use a cube, so that the cells do not become elongated */
+        Vector3f extents = bbox.getExtents();
+        float size = std::max(extents.maxCoeff(), Epsilon) * (1.f + 1e-4f);
+        m_bbox = BoundingBox3f(bbox.min, bbox.min + Vector3f::Constant(size));
+        m_nodes.clear();
+        m_nodes.push_back(Node { { 0, 0 }, 0, 0 });
+        m_leaves.clear();
+        m_leaves.emplace_back();
+    }
+
+    size_t getNodeCount() const { return m_nodes.size(); }
+
+    std::vector<Leaf> &getLeaves() { return m_leaves; }
+
+    /// Return the leaf that contains a position
+    Leaf &lookup(const Point3f &p) {
+        Vector3f rel = (p - m_bbox.min).cwiseQuotient(m_bbox.getExtents());
+        for (int i = 0; i < 3; ++i)
+            rel[i] = clamp(rel[i], 0.f, OneMinusEpsilon);
+        uint32_t index = 0;
+        while (m_nodes[index].children[0]) {
+            const Node &node = m_nodes[index];
+            float &x = rel[node.axis];
+            x *= 2.f;
+            if (x < 1.f) {
+                index = node.children[0];
+            } else {
+                x = std::min(x - 1.f, OneMinusEpsilon);
+                index = node.children[1];
+            }
+        }
+        return m_leaves[m_nodes[index].leaf];
+    }
+
+    /**
+     * \brief Split all leaves that recorded more than \c threshold samples
+     *
+     * Both halves start with a copy of the quadtrees of the leaf and with
+     * half of its samples, hence leaves are split repeatedly until they fall
+     * below the threshold.
+     */
+    void subdivide(float threshold) {
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].children[0])
+                continue;
+            uint32_t leaf = m_nodes[i].leaf;
+            uint32_t sampleCount = m_leaves[leaf].building.getSampleCount();
+            if (sampleCount <= threshold)
+                continue;
+
+            m_leaves[leaf].building.setSampleCount(sampleCount / 2);
+            uint32_t newLeaf = (uint32_t) m_leaves.size();
+            m_leaves.push_back(m_leaves[leaf]);
+
+            int axis = (m_nodes[i].axis + 1) % 3;
+            uint32_t child = (uint32_t) m_nodes.size();
+            m_nodes.push_back(Node { { 0, 0 }, axis, leaf });
+            m_nodes.push_back(Node { { 0, 0 }, axis, newLeaf });
+            m_nodes[i].children[0] = child;
+            m_nodes[i].children[1] = child + 1;
+        }
+    }
+
+private:
+    struct Node {
+        /// Indices of the two halves (zero for leaves)
+        uint32_t children[2];
+        /// Axis along which the node is split
+        int axis;
+        /// Index into \ref m_leaves
+        uint32_t leaf;
+    };
+
+    BoundingBox3f m_bbox;
+    std::vector<Node> m_nodes;
+    std::vector<Leaf> m_leaves;
+};
+
+/**
+ * \brief Path tracer that learns the incident radiance and uses it to
+ * guide the sampling of directions
+ *
+ * The first passes are training passes: the radiance that arrives at every
+ * diffuse path vertex is recorded in an \ref SDTree. After each training
+ * pass, the tree is refined and the recorded radiance is used to sample
+ * directions during the following pass. The passes double in size, so that
+ * every refinement is based on twice as many samples as the previous one.
+ * Once \c trainingSamples samples per pixel have been rendered, the tree
+ * remains fixed for the rest of the render.
+ *
+ * Directions are drawn from a one-sample mixture of the BSDF and the
+ * learned distribution, and the density of the mixture is used for
+ * multiple importance sampling with next event estimation. The estimator
+ * is therefore unbiased regardless of the quality of the learned
+ * distribution, and the training passes are part of the final image.
+ */
+class GuidedPathIntegrator : public Integrator {
+public:
+    GuidedPathIntegrator(const PropertyList &props) {
+        /* Probability of sampling the BSDF instead of the learned distribution */
+        m_bsdfSamplingFraction = clamp(props.getFloat("bsdfSamplingFraction", 0.5f), 0.f, 1.f);
+
+        /* Samples per pixel used for training (default: half of the samples) */
+        m_trainingSamples = props.getInteger("trainingSamples", -1);
+
+        /* Maximum number of samples that a spatial leaf may record during a
+           pass of one sample per pixel (scales with the square root of the pass size) */
+        m_spatialThreshold = props.getFloat("spatialThreshold", 12000.f);
+
+        /* Quadrants that receive more than this fraction of the radiance are subdivided */
+        m_directionalThreshold = props.getFloat("directionalThreshold", 0.01f);
+
+        /* Maximum number of bounces (-1: unlimited, terminated by Russian roulette) */
+        m_maxDepth = props.getInteger("maxDepth", -1);
+    }
+
+    void preprocess(const Scene *scene) {
+        m_trainingSampleCount = m_trainingSamples >= 0 ? (size_t) m_trainingSamples
+            : scene->getSampler()->getSampleCount() / 2;
+        m_training = m_trainingSampleCount > 0;
+        m_sdTree.clear(scene->getBoundingBox());
+    }
+
+    size_t getPassSize(size_t samplesDone, size_t passSize) const {
+        if (samplesDone >= m_trainingSampleCount)
+            return passSize;
+
+        /* Training passes of 1, 2, 4, .. samples per pixel. The last pass
+           also takes the remainder if another doubling does not fit */
+        size_t size = 1;
+        while (2 * size <= samplesDone + 1)
+            size *= 2;
+        size_t remaining = m_trainingSampleCount - samplesDone;
+        return remaining < 2 * size ? remaining : size;
+    }
+
+    void finishPass(const Scene *scene, size_t passSamples, size_t samplesDone) const {
+        if (!m_training)
+            return;
+
+        for (auto &leaf : m_sdTree.getLeaves())
+            leaf.building.build();
+
+        m_sdTree.subdivide(m_spatialThreshold * std::sqrt((float) passSamples));
+
+        for (auto &leaf : m_sdTree.getLeaves()) {
+            leaf.sampling = leaf.building;
+            leaf.building.refine(leaf.sampling, m_directionalThreshold, MaxDirectionalDepth);
+        }
+
+        if (samplesDone >= m_trainingSampleCount)
+            m_training = false;
+    }
+
+    bool requiresPasses() const { return m_training; }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const {
+        Color3f L(0.f), throughput(1.f);
+        Ray3f ray(cameraRay);
+
+        /* Vertices whose incident radiance is recorded during training passes */
+        Vertex vertices[MaxRecordedVertices];
+        int vertexCount = 0;
+        bool training = m_training;
+
+        /* State of the previous vertex for multiple importance sampling */
+        bool specular = true;
+        float directionPdf = 0.f;
+        Point3f prevP(0.f);
+        Normal3f prevN(0.f);
+
+        for (int depth = 0; ; ++depth) {
+            Intersection its;
+            if (!scene->rayIntersect(ray, its)) {
+                if (scene->getEnvironment()) {
+                    float weight = specular ? 1.f : misWeight(directionPdf, scene->pdfEnvironment(ray));
+                    L += throughput * scene->evalEnvironment(ray) * weight;
+                }
+                break;
+            }
+
+            if (its.mesh->isEmitter()) {
+                Color3f Le = its.mesh->getEmission(its, -ray.d);
+                if (!Le.isZero()) {
+                    float weight = specular ? 1.f
+                        : misWeight(directionPdf, scene->pdfEmitterPosition(prevP, prevN, its));
+                    L += throughput * Le * weight;
+                }
+            }
+
+            if (m_maxDepth >= 0 && depth >= m_maxDepth)
+                break;
+
+            const BSDF *bsdf = its.mesh->getBSDF();
+            Vector3f wi = its.shFrame.toLocal(-ray.d);
+            bool guided = bsdf->isDiffuse();
+            SDTree::Leaf *leaf = guided ? &m_sdTree.lookup(its.p) : nullptr;
+            float bsdfFraction = (leaf && leaf->sampling.isValid()) ? m_bsdfSamplingFraction : 1.f;
+
+            /* Next event estimation */
+            if (guided) {
+                EmitterQueryRecord eRec;
+                float lightPdf;
+                float emitterSample = sampler->next1D();
+                const Emitter *emitter = scene->sampleEmitterPosition(its.p, its.shFrame.n,
+                    emitterSample, sampler->next2D(), eRec, lightPdf);
+                if (emitter && lightPdf > 0 && eRec.normal.dot(its.p - eRec.point) > 0 &&
+                    scene->illuminatedEachOther(its.p, eRec.point)) {
+                    Vector3f d = (eRec.point - its.p).normalized();
+                    BSDFQueryRecord bRec(wi, its.shFrame.toLocal(d), ESolidAngle, sampler);
+                    Color3f Le = emitter->eval(eRec) * misWeight(lightPdf,
+                        pdfDirection(bsdf, bRec, leaf, d, bsdfFraction));
+                    L += throughput * Le * bsdf->eval(bRec) * std::abs(its.shFrame.n.dot(d)) / lightPdf;
+                    if (training)
+                        leaf->building.record(directionToCanonical(d), Le.getLuminance() / lightPdf);
+                }
+            }
+
+            /* Choose the next direction from the mixture of the BSDF and the learned distribution */
+            BSDFQueryRecord bRec(wi, sampler);
+            Color3f weight;
+            float sampleBSDF = sampler->next1D();
+            Point2f directionSample = sampler->next2D();
+            if (sampleBSDF < bsdfFraction) {
+                weight = bsdf->sample(bRec, directionSample);
+                if (weight.isZero())
+                    break;
+                if (bsdfFraction < 1.f && bRec.measure == ESolidAngle) {
+                    Vector3f d = its.shFrame.toWorld(bRec.wo);
+                    directionPdf = pdfDirection(bsdf, bRec, leaf, d, bsdfFraction);
+                    weight = directionPdf > 0 ? Color3f(bsdf->eval(bRec) * std::abs(Frame::cosTheta(bRec.wo)) / directionPdf)
+                                              : Color3f(0.f);
+                } else {
+                    directionPdf = bRec.measure == ESolidAngle ? bsdf->pdf(bRec) : 0.f;
+                }
+            } else {
+                Vector3f d = canonicalToDirection(leaf->sampling.sample(directionSample));
+                bRec.wo = its.shFrame.toLocal(d);
+                bRec.measure = ESolidAngle;
+                directionPdf = pdfDirection(bsdf, bRec, leaf, d, bsdfFraction);
+                weight = directionPdf > 0 ? Color3f(bsdf->eval(bRec) * std::abs(Frame::cosTheta(bRec.wo)) / directionPdf)
+                                          : Color3f(0.f);
+            }
+            if (weight.isZero() || !weight.isValid())
+                break;
+
+            throughput *= weight;
+            specular = !guided;
+            prevP = its.p;
+            prevN = its.shFrame.n;
+            ray = Ray3f(its.p, its.shFrame.toWorld(bRec.wo));
+
+            if (training && guided && vertexCount < MaxRecordedVertices && directionPdf > 0)
+                vertices[vertexCount++] = Vertex { leaf, directionToCanonical(ray.d), throughput, L, directionPdf };
+
+            /* Russian roulette */
+            if (depth >= 3) {
+                float q = std::min(throughput.maxCoeff(), 0.95f);
+                if (sampler->next1D() >= q)
+                    break;
+                throughput /= q;
+            }
+        }
+
+        /* The radiance that arrived at a vertex is the radiance that was
+           gathered after it, divided by the throughput up to the vertex */
+        for (int i = 0; i < vertexCount; ++i) {
+            const Vertex &vertex = vertices[i];
+            Color3f Li(0.f);
+            for (int c = 0; c < 3; ++c)
+                if (vertex.throughput[c] > 0)
+                    Li[c] = (L[c] - vertex.radiance[c]) / vertex.throughput[c];
+            vertex.leaf->building.record(vertex.direction, Li.getLuminance() / vertex.pdf);
+        }
+
+        return L;
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "GuidedPathIntegrator[\n"
+            "  bsdfSamplingFraction = %f,\n"
+            "  trainingSamples = %i,\n"
+            "  spatialThreshold = %f,\n"
+            "  directionalThreshold = %f,\n"
+            "  maxDepth = %i\n"
+            "]",
+            m_bsdfSamplingFraction, m_trainingSamples,
+            m_spatialThreshold, m_directionalThreshold, m_maxDepth);
+    }
+
+private:
+    /// Maximum depth of the directional quadtrees
+    static const int MaxDirectionalDepth = 20;
+    /// Number of vertices per path whose radiance is recorded
+    static const int MaxRecordedVertices = 32;
+
+    /// Path vertex whose incident radiance is recorded
+    struct Vertex {
+        SDTree::Leaf *leaf;
+        Point2f direction;
+        /// Throughput including the sampled direction
+        Color3f throughput;
+        /// Radiance of the path when the vertex was created
+        Color3f radiance;
+        float pdf;
+    };
+
+    /// Solid angle density of the direction sampling mixture
+    float pdfDirection(const BSDF *bsdf, const BSDFQueryRecord &bRec,
+                       const SDTree::Leaf *leaf, const Vector3f &d, float bsdfFraction) const {
+        float pdf = bsdfFraction * bsdf->pdf(bRec);
+        if (bsdfFraction < 1.f)
+            pdf += (1.f - bsdfFraction) * leaf->sampling.pdf(directionToCanonical(d)) * INV_FOURPI;
+        return pdf;
+    }
+
+    /// Balance heuristic
+    static float misWeight(float pdf, float otherPdf) {
+        return pdf + otherPdf > 0 ? pdf / (pdf + otherPdf) : 0.f;
+    }
+
+    float m_bsdfSamplingFraction;
+    int m_trainingSamples;
+    float m_spatialThreshold;
+    float m_directionalThreshold;
+    int m_maxDepth;
+    size_t m_trainingSampleCount = 0;
+
+    /* Updated between passes by finishPass() */
+    mutable SDTree m_sdTree;
+    mutable bool m_training = false;
+};
+
+NORI_REGISTER_CLASS(GuidedPathIntegrator, "path_guided");
+NORI_NAMESPACE_END
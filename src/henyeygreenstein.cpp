@@ -12,13 +12,15 @@ float HenyeyGreenstein::p(const Vector3f &wi, const Vector3f &wo) const {
 }
 
 float HenyeyGreenstein::sample(const Vector3f &wi, Vector3f &wo, const Point2f &sample) const {
+    /* Both directions point away from the scattering location, hence
+       forward scattering (g > 0) favors wo close to -wi as in p() */
     float cosTheta;
     if (std::abs(m_g) < 1e-3)
         cosTheta = 1 - 2 * sample.x();
     else {
         float sqrTerm = (1 - m_g * m_g) /
                         (1 - m_g + 2 * m_g * sample.x());
-        cosTheta = (1 + m_g * m_g - sqrTerm * sqrTerm) / (2 * m_g);
+        cosTheta = -(1 + m_g * m_g - sqrTerm * sqrTerm) / (2 * m_g);
     }
 
     float phi = 2 * M_PI * sample.y();
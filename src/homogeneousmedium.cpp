@@ -15,7 +15,7 @@ public:
     HomogeneousMedium(const PropertyList &propList) {
         sigma_a = propList.getColor("sigma_a", Color3f(0.1f));
         sigma_s = propList.getColor("sigma_s", Color3f(0.2f));
-        emittance = propList.getColor("emittance", Color3f(1.f));
+        emittance = propList.getColor("emittance", Color3f(0.f));
         g = propList.getFloat("g", 0.f);
         sigma_t = sigma_s + sigma_a;
         m_phase = std::make_shared<HenyeyGreenstein>(g);
@@ -26,8 +26,10 @@ public:
         return Color3f(std::exp(exponent.x()), std::exp(exponent.y()), std::exp(exponent.z()));
     }
 
-    Color3f sample(const Ray3f &ray, Sampler *sampler, Intersection &its) const override {
-        int channel = std::min((int) (sampler->next1D() * 3), 2);
+    Color3f sample(const Ray3f &ray, Sampler *sampler, Intersection &its,
+                   const Color3f &throughput) const override {
+        Color3f channelPdfs = channelPdf(throughput);
+        int channel = sampleChannel(channelPdfs, sampler->next1D());
         float dist = -std::log(1 - sampler->next1D()) / sigma_t[channel];
         float t = std::min(dist * ray.d.norm(), ray.maxt);
         its.t = t;
@@ -40,9 +42,9 @@ public:
         Color3f e = -sigma_t * t;
         Color3f transmission(std::exp(e.x()), std::exp(e.y()), std::exp(e.z()));
 
+        /* Balance heuristic over the distance densities of all channels */
         Color3f density = sampledMedium ? (sigma_t * transmission) : transmission;
-        float pdf = density.x() + density.y() + density.z();
-        pdf /= 3;
+        float pdf = (channelPdfs * density).sum();
         return (Color3f) (transmission / pdf);
     }
 
@@ -54,6 +56,10 @@ public:
         return sigma_s;
     }
 
+    bool isHomogeneous() const override {
+        return true;
+    }
+
     Color3f getEmittance(const Point3f &point, const Vector3f &w) const override {
         return emittance;
     }
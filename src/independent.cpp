@@ -6,6 +6,7 @@
 
 #include <nori/sampler.h>
 #include <nori/block.h>
+#include <nori/hash.h>
 #include <pcg32.h>
 
 NORI_NAMESPACE_BEGIN
@@ -15,8 +16,10 @@ NORI_NAMESPACE_BEGIN
  * random numbers on <tt>[0, 1)x[0, 1)</tt>.
  *
  * This class is essentially just a wrapper around the pcg32 pseudorandom
- * number generator. For more details on what sample generators do in
- * general, refer to the \ref Sampler class.
+ * number generator. Every (pixel, sample index) pair uses its own pcg32
+ * stream, and the dimensions of a sample are consecutive values of this
+ * stream. For more details on what sample generators do in general, refer
+ * to the \ref Sampler class.
  */
 class Independent : public Sampler {
 public:
@@ -29,19 +32,26 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
         cloned->m_random = m_random;
+        cloned->m_pixelHash = m_pixelHash;
+        cloned->m_sampleIndex = m_sampleIndex;
         return std::move(cloned);
     }
 
-    void prepare(const ImageBlock &block) {
-        m_random.seed(
-            block.getOffset().x(),
-            block.getOffset().y()
-        );
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        /* Sample indices are global, hence a progressive or resumed
+           render draws the same samples as a single-pass render */
+        m_pixelHash = hashCombine((uint64_t) (uint32_t) pixel.x(), (uint64_t) (uint32_t) pixel.y());
+        m_sampleIndex = m_sampleOffset;
+        m_random.seed(mixBits(m_sampleIndex), m_pixelHash);
     }
 
-    void generate() { /* No-op for this sampler */ }
-    void advance()  { /* No-op for this sampler */ }
+    void advance() {
+        m_random.seed(mixBits(++m_sampleIndex), m_pixelHash);
+    }
 
     float next1D() {
         return m_random.nextFloat();
@@ -62,6 +72,8 @@ protected:
 
 private:
     pcg32 m_random;
+    uint64_t m_pixelHash = 0;
+    uint64_t m_sampleIndex = 0;
 };
 
 NORI_REGISTER_CLASS(Independent, "independent");
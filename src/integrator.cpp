@@ -7,16 +7,50 @@
 #include <nori/emitter.h>
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
+#include <nori/camera.h>
+#include <nori/block.h>
 
 NORI_NAMESPACE_BEGIN
 
+void Integrator::renderBlock(const Scene *scene, Sampler *sampler,
+                             ImageBlock &block, size_t sampleCount) const {
+    const Camera *camera = scene->getCamera();
+
+    Point2i offset = block.getOffset();
+    Vector2i size  = block.getSize();
+
+    /* For each pixel and pixel sample sample */
+    for (int y=0; y<size.y(); ++y) {
+        for (int x=0; x<size.x(); ++x) {
+            sampler->generate(Point2i(x + offset.x(), y + offset.y()));
+
+            for (uint32_t i=0; i<sampleCount; ++i) {
+                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+
+                /* Sample a ray from the camera */
+                Ray3f ray;
+                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+
+                /* Compute the incident radiance */
+                value *= Li(scene, sampler, ray);
+
+                /* Store in the image block */
+                block.put(pixelSample, value);
+
+                sampler->advance();
+            }
+        }
+    }
+}
+
 Color3f Integrator::estimateDirect(const Intersection &its,
                                    const Vector3f &w, const Scene *scene, Sampler *sampler) const {
     Color3f L_dir(0);
-    auto lights = scene->getEmitters();
-    Emitter *pLight = lights[std::rand() % lights.size()]->getEmitter();
+    float lightPdf;
+    const Emitter *pLight = scene->sampleEmitter(sampler->next1D(), lightPdf);
     EmitterQueryRecord eRec;
-    Color3f l_i = pLight->sample(its.p, eRec, sampler->next2D()) * lights.size();
+    Color3f l_i = pLight->sample(its.p, eRec, sampler->next2D()) / lightPdf;
     Vector3f wi = (eRec.point - its.p).normalized();
 
     if (!scene->illuminatedEachOther(its.p, eRec.point)) {
@@ -0,0 +1,379 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/lightbvh.h>
+#include <nori/lowdiscrepancy.h>
+#include <nori/emitter.h>
+#include <nori/mesh.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Number of bins per axis that are considered for the splits
+    const int BinCount = 12;
+
+    inline float safeSqrt(float value) {
+        return std::sqrt(std::max(value, 0.f));
+    }
+
+    /// Cosine of <tt>max(0, a - b)</tt>, given sines and cosines of the angles
+    inline float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        if (cosA > cosB)
+            return 1.f;
+        return cosA * cosB + sinA * sinB;
+    }
+
+    /// Sine of <tt>max(0, a - b)</tt>, given sines and cosines of the angles
+    inline float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        if (cosA > cosB)
+            return 0.f;
+        return sinA * cosB - cosA * sinB;
+    }
+
+    /**
+     * Solid angle measure of the directions into which a cone of emitters
+     * radiates, assuming that every emitter covers the hemisphere around its
+     * normal. Used by the surface area orientation heuristic (SAOH).
+     */
+    inline float orientationMeasure(float cosTheta) {
+        float thetaO = std::acos(clamp(cosTheta, -1.f, 1.f));
+        float thetaW = std::min(thetaO + 0.5f * M_PI, M_PI);
+        float sinThetaO = std::sin(thetaO);
+        return 2 * M_PI * (1 - cosTheta) +
+            0.5f * M_PI * (2 * thetaW * sinThetaO - std::cos(thetaO - 2 * thetaW)
+                           - 2 * thetaO * sinThetaO + cosTheta);
+    }
+}
+
+LightBVH::NormalCone LightBVH::NormalCone::merge(const NormalCone &a, const NormalCone &b) {
+    if (a.empty)
+        return b;
+    if (b.empty)
+        return a;
+
+    /* Check if one of the cones already contains the other one */
+    float thetaA = std::acos(clamp(a.cosTheta, -1.f, 1.f));
+    float thetaB = std::acos(clamp(b.cosTheta, -1.f, 1.f));
+    float thetaD = std::acos(clamp(a.axis.dot(b.axis), -1.f, 1.f));
+    if (std::min(thetaD + thetaB, M_PI) <= thetaA)
+        return a;
+    if (std::min(thetaD + thetaA, M_PI) <= thetaB)
+        return b;
+
+    NormalCone result;
+    result.empty = false;
+    float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+    Vector3f rotationAxis = a.axis.cross(b.axis);
+    if (thetaO >= M_PI || rotationAxis.squaredNorm() == 0) {
+        /* All directions */
+        result.axis = a.axis;
+        result.cosTheta = -1.f;
+        return result;
+    }
+
+    /* Rotate the axis of 'a' towards 'b' */
+    float thetaR = thetaO - thetaA;
+    result.axis = (Eigen::AngleAxisf(thetaR, rotationAxis.normalized()) * a.axis).normalized();
+    result.cosTheta = std::cos(thetaO);
+    return result;
+}
+
+void LightBVH::LightBounds::expandBy(const LightBounds &bounds) {
+    bbox.expandBy(bounds.bbox);
+    cone = NormalCone::merge(cone, bounds.cone);
+    power += bounds.power;
+}
+
+void LightBVH::clear() {
+    m_emitters.clear();
+    m_emitterIndices.clear();
+    m_primitives.clear();
+    m_nodes.clear();
+    m_parents.clear();
+    m_leaves.clear();
+    m_leafOffsets.clear();
+}
+
+void LightBVH::build(const std::vector<Mesh *> &emitters) {
+    clear();
+
+    std::vector<BuildPrimitive> primitives;
+    uint32_t triangleCount = 0;
+    for (uint32_t i = 0; i < (uint32_t) emitters.size(); ++i) {
+        const Mesh *mesh = emitters[i];
+        m_emitters.push_back(mesh);
+        m_emitterIndices[mesh] = i;
+        m_leafOffsets.push_back(triangleCount);
+        triangleCount += mesh->getTriangleCount();
+
+        float luminance = mesh->getEmitter()->emission().getLuminance();
+        const MatrixXf &V = mesh->getVertexPositions();
+        const MatrixXf &N = mesh->getVertexNormals();
+        const MatrixXu &F = mesh->getIndices();
+
+        for (uint32_t face = 0; face < mesh->getTriangleCount(); ++face) {
+            BuildPrimitive prim;
+            prim.primitive.emitter = i;
+            prim.primitive.face = face;
+            prim.bounds.bbox = mesh->getBoundingBox(face);
+            prim.bounds.power = M_PI * luminance * mesh->surfaceArea(face);
+            prim.centroid = mesh->getCentroid(face);
+
+            /* Triangles without power are never chosen */
+            if (!(prim.bounds.power > 0))
+                continue;
+
+            /* The emission follows the (interpolated) shading normal,
+               which lies within the cone of the vertex normals */
+            if (N.size() > 0) {
+                for (int k = 0; k < 3; ++k) {
+                    NormalCone cone;
+                    cone.axis = N.col(F(k, face)).normalized();
+                    cone.cosTheta = 1.f;
+                    cone.empty = false;
+                    prim.bounds.cone = NormalCone::merge(prim.bounds.cone, cone);
+                }
+            } else {
+                Point3f p0 = V.col(F(0, face)), p1 = V.col(F(1, face)), p2 = V.col(F(2, face));
+                prim.bounds.cone.axis = (p1 - p0).cross(p2 - p0).normalized();
+                prim.bounds.cone.cosTheta = 1.f;
+                prim.bounds.cone.empty = false;
+            }
+            primitives.push_back(prim);
+        }
+    }
+
+    m_leaves.assign(triangleCount, (uint32_t) -1);
+    if (primitives.empty())
+        return;
+
+    m_nodes.reserve(2 * primitives.size() - 1);
+    m_parents.reserve(2 * primitives.size() - 1);
+    m_primitives.resize(primitives.size());
+    buildRecursive(primitives, 0, (uint32_t) primitives.size());
+}
+
+uint32_t LightBVH::buildRecursive(std::vector<BuildPrimitive> &primitives,
+                                  uint32_t start, uint32_t end) {
+    uint32_t index = (uint32_t) m_nodes.size();
+    m_nodes.emplace_back();
+    m_parents.push_back((uint32_t) -1);
+
+    LightBounds total;
+    BoundingBox3f centroidBounds;
+    for (uint32_t i = start; i < end; ++i) {
+        total.expandBy(primitives[i].bounds);
+        centroidBounds.expandBy(primitives[i].centroid);
+    }
+
+    Node node;
+    node.bbox = total.bbox;
+    node.axis = total.cone.axis;
+    node.cosTheta = total.cone.cosTheta;
+    node.power = total.power;
+
+    if (end - start == 1) {
+        const Primitive &prim = primitives[start].primitive;
+        m_primitives[start] = prim;
+        m_leaves[m_leafOffsets[prim.emitter] + prim.face] = index;
+        node.offset = start;
+        node.leaf = true;
+        m_nodes[index] = node;
+        return index;
+    }
+
+    /* Find the split with the lowest surface area orientation heuristic
+       cost, evaluated at bin boundaries along all three axes */
+    Vector3f extents = total.bbox.getExtents();
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestAxis = -1, bestBin = -1;
+    for (int axis = 0; axis < 3; ++axis) {
+        float minCentroid = centroidBounds.min[axis];
+        float extent = centroidBounds.max[axis] - minCentroid;
+        if (!(extent > 0))
+            continue;
+
+        LightBounds bins[BinCount];
+        uint32_t counts[BinCount] = { 0 };
+        for (uint32_t i = start; i < end; ++i) {
+            int bin = std::min((int) ((primitives[i].centroid[axis] - minCentroid)
+                                      / extent * BinCount), BinCount - 1);
+            bins[bin].expandBy(primitives[i].bounds);
+            ++counts[bin];
+        }
+
+        /* Penalize splits of thin boxes across their short side */
+        float kr = extents.maxCoeff() / std::max(extents[axis], Epsilon);
+
+        float costBelow[BinCount];
+        LightBounds below;
+        for (int bin = 0; bin < BinCount - 1; ++bin) {
+            below.expandBy(bins[bin]);
+            costBelow[bin] = below.power * orientationMeasure(below.cone.cosTheta)
+                * (below.bbox.isValid() ? below.bbox.getSurfaceArea() : 0.f);
+        }
+
+        LightBounds above;
+        uint32_t countAbove = 0;
+        for (int bin = BinCount - 1; bin >= 1; --bin) {
+            above.expandBy(bins[bin]);
+            countAbove += counts[bin];
+            if (countAbove == 0 || countAbove == end - start)
+                continue;
+            float costAbove = above.power * orientationMeasure(above.cone.cosTheta)
+                * above.bbox.getSurfaceArea();
+            float cost = kr * (costBelow[bin - 1] + costAbove);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    uint32_t mid;
+    if (bestAxis >= 0) {
+        float minCentroid = centroidBounds.min[bestAxis];
+        float extent = centroidBounds.max[bestAxis] - minCentroid;
+        mid = (uint32_t) (std::partition(
+            primitives.begin() + start, primitives.begin() + end,
+            [&](const BuildPrimitive &prim) {
+                int bin = std::min((int) ((prim.centroid[bestAxis] - minCentroid)
+                                          / extent * BinCount), BinCount - 1);
+                return bin < bestBin;
+            }) - primitives.begin());
+    } else {
+        /* All centroids coincide, split by count */
+        mid = (start + end) / 2;
+    }
+
+    uint32_t left = buildRecursive(primitives, start, mid);
+    uint32_t right = buildRecursive(primitives, mid, end);
+    m_parents[left] = m_parents[right] = index;
+
+    node.offset = right;
+    node.leaf = false;
+    m_nodes[index] = node;
+    return index;
+}
+
+float LightBVH::importance(const Node &node, const Point3f &p, const Normal3f &n) const {
+    /* Bound the emitters by a sphere around the center of the node */
+    Point3f center = node.bbox.getCenter();
+    float radius2 = (node.bbox.max - center).squaredNorm();
+    Vector3f wi = p - center;
+    float dist2 = wi.squaredNorm();
+
+    /* Inside the sphere, the emitters may lie in any direction */
+    if (dist2 <= radius2)
+        return node.power / std::max(radius2, Epsilon * Epsilon);
+
+    wi /= std::sqrt(dist2);
+
+    /* Angle between the normal cone and the direction towards the point */
+    float cosThetaW = node.axis.dot(wi);
+    float sinThetaW = safeSqrt(1 - cosThetaW * cosThetaW);
+    float cosThetaO = node.cosTheta;
+    float sinThetaO = safeSqrt(1 - cosThetaO * cosThetaO);
+
+    /* Half-angle of the cone of directions subtended by the sphere */
+    float sinThetaB2 = radius2 / dist2;
+    float sinThetaB = std::sqrt(sinThetaB2);
+    float cosThetaB = safeSqrt(1 - sinThetaB2);
+
+    /* Smallest angle between the normals of the emitters and the direction
+       towards the point, accounting for the extent of the node */
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float cosTheta = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+
+    /* The emitters only radiate into the hemisphere around their normal */
+    if (cosTheta <= 0)
+        return 0.f;
+
+    float result = node.power * cosTheta / dist2;
+
+    /* Foreshortening at the shading point */
+    if (n.squaredNorm() > 0) {
+        float cosThetaI = std::abs(wi.dot(n));
+        float sinThetaI = safeSqrt(1 - cosThetaI * cosThetaI);
+        result *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+
+    return std::max(result, 0.f);
+}
+
+bool LightBVH::sample(const Point3f &p, const Normal3f &n, float sample,
+                      const Mesh *&mesh, uint32_t &face, float &pmf) const {
+    if (m_nodes.empty())
+        return false;
+
+    uint32_t index = 0;
+    pmf = 1.f;
+    while (true) {
+        const Node &node = m_nodes[index];
+        if (node.leaf) {
+            if (index == 0 && !(importance(node, p, n) > 0))
+                return false;
+            const Primitive &prim = m_primitives[node.offset];
+            mesh = m_emitters[prim.emitter];
+            face = prim.face;
+            return true;
+        }
+
+        /* Choose a child proportionally to its importance */
+        float importance0 = importance(m_nodes[index + 1], p, n);
+        float importance1 = importance(m_nodes[node.offset], p, n);
+        if (!(importance0 + importance1 > 0))
+            return false;
+        float prob0 = importance0 / (importance0 + importance1);
+
+        if (sample < prob0) {
+            sample = std::min(sample / prob0, OneMinusEpsilon);
+            pmf *= prob0;
+            index = index + 1;
+        } else {
+            sample = std::min((sample - prob0) / (1 - prob0), OneMinusEpsilon);
+            pmf *= 1 - prob0;
+            index = node.offset;
+        }
+    }
+}
+
+float LightBVH::pmf(const Point3f &p, const Normal3f &n, const Mesh *mesh, uint32_t face) const {
+    auto it = m_emitterIndices.find(mesh);
+    if (it == m_emitterIndices.end() || m_nodes.empty())
+        return 0.f;
+    uint32_t index = m_leaves[m_leafOffsets[it->second] + face];
+    if (index == (uint32_t) -1)
+        return 0.f;
+    if (index == 0)
+        return importance(m_nodes[0], p, n) > 0 ? 1.f : 0.f;
+
+    /* Walk up to the root, mirroring the decisions of sample() */
+    float result = 1.f;
+    while (index != 0) {
+        uint32_t parent = m_parents[index];
+        const Node &node = m_nodes[parent];
+        float importance0 = importance(m_nodes[parent + 1], p, n);
+        float importance1 = importance(m_nodes[node.offset], p, n);
+        if (!(importance0 + importance1 > 0))
+            return 0.f;
+        float prob0 = importance0 / (importance0 + importance1);
+        result *= (index == parent + 1) ? prob0 : 1 - prob0;
+        index = parent;
+    }
+    return result;
+}
+
+std::string LightBVH::toString() const {
+    return tfm::format("LightBVH[nodes=%i, triangles=%i]",
+                       m_nodes.size(), m_primitives.size());
+}
+
+NORI_NAMESPACE_END
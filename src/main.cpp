@@ -13,60 +13,81 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
-#include <tbb/parallel_for.h>
-#include <tbb/blocked_range.h>
+#include <nori/checkpoint.h>
+#include <nori/render.h>
+#include <nori/distributed.h>
+#include <nori/server.h>
 #include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
 #include <thread>
+#include <cstdio>
 
 using namespace nori;
 
 static int threadCount = -1;
 static bool gui = true;
-
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
-    const Camera *camera = scene->getCamera();
-    const Integrator *integrator = scene->getIntegrator();
-
-    Point2i offset = block.getOffset();
-    Vector2i size  = block.getSize();
-
-    /* Clear the block contents */
-    block.clear();
-
-    /* For each pixel and pixel sample sample */
-    for (int y=0; y<size.y(); ++y) {
-        for (int x=0; x<size.x(); ++x) {
-            for (uint32_t i=0; i<sampler->getSampleCount(); ++i) {
-                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-                Point2f apertureSample = sampler->next2D();
-
-                /* Sample a ray from the camera */
-                Ray3f ray;
-                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
-
-                /* Compute the incident radiance */
-                value *= integrator->Li(scene, sampler, ray);
-
-                /* Store in the image block */
-                block.put(pixelSample, value);
-            }
-        }
-    }
-}
+static int sppPerPass = 0;              /* 0: render all samples in a single pass */
+static double checkpointInterval = -1;  /* Seconds between checkpoints, < 0: disabled */
+static std::string checkpointName = ""; /* Default: <scene>.checkpoint */
+static bool resume = false;
+static bool deterministic = false;      /* Bitwise identical output for any thread count */
+static bool crop = false;               /* Override the crop window of the camera */
+static Point2i cropOffset(0, 0);
+static Vector2i cropSize(0, 0);
+static std::string mergeName = "";      /* Paste the crop window into this EXR file */
+static std::string coordinatorAddress = ""; /* Distribute blocks to workers listening here */
+static std::string workerAddress = "";      /* Render blocks for the coordinator at this address */
+static std::string serverAddress = "";      /* Accept render jobs at this address */
 
 static void render(Scene *scene, const std::string &filename) {
     const Camera *camera = scene->getCamera();
     Vector2i outputSize = camera->getOutputSize();
     scene->getIntegrator()->preprocess(scene);
 
-    /* Create a block generator (i.e. a work scheduler) */
-    BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+    /* Determine the filename of the output bitmap */
+    std::string outputName = filename;
+    size_t lastdot = outputName.find_last_of(".");
+    if (lastdot != std::string::npos)
+        outputName.erase(lastdot, std::string::npos);
+
+    /* Load the image that the crop window will be pasted into. Do this
+       first, so that a mismatch is reported before spending any time */
+    std::unique_ptr<Bitmap> mergeTarget;
+    if (!mergeName.empty()) {
+        mergeTarget.reset(new Bitmap(mergeName));
+        if (mergeTarget->cols() != outputSize.x() || mergeTarget->rows() != outputSize.y())
+            throw NoriException("The resolution of \"%s\" (%ix%i) does not match the scene (%ix%i)",
+                                mergeName, mergeTarget->cols(), mergeTarget->rows(),
+                                outputSize.x(), outputSize.y());
+    }
 
     /* Allocate memory for the entire output image and clear it */
     ImageBlock result(outputSize, camera->getReconstructionFilter());
     result.clear();
 
+    /* Split the pixel samples into passes. Checkpoints can only be
+       written between two passes, hence default to one sample per pass */
+    size_t sampleCount = scene->getSampler()->getSampleCount();
+    size_t passSize = sampleCount;
+    if (sppPerPass > 0)
+        passSize = std::min(sampleCount, (size_t) sppPerPass);
+    else if (checkpointInterval >= 0)
+        passSize = 1;
+
+    std::string checkpointPath = checkpointName.empty() ?
+        outputName + ".checkpoint" : checkpointName;
+
+    size_t samplesDone = 0;
+    if (resume) {
+        if (filesystem::path(checkpointPath).exists()) {
+            samplesDone = loadCheckpoint(checkpointPath, scene, result);
+            cout << "Resuming from \"" << checkpointPath << "\" (" << samplesDone
+                 << "/" << sampleCount << " samples per pixel done)" << endl;
+        } else {
+            cout << "No checkpoint \"" << checkpointPath << "\" found, starting from scratch" << endl;
+        }
+    }
+
     /* Create a window that visualizes the partially rendered result */
     NoriScreen *screen = nullptr;
     if (gui) {
@@ -75,45 +96,39 @@ static void render(Scene *scene, const std::string &filename) {
     }
 
     /* Do the following in parallel and asynchronously */
+    std::string coordinatorError;
     std::thread render_thread([&] {
         tbb::task_scheduler_init init(threadCount);
 
         cout << "Rendering .. ";
         cout.flush();
-        Timer timer;
-
-        tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
-
-        auto map = [&](const tbb::blocked_range<int> &range) {
-            /* Allocate memory for a small image block to be rendered
-               by the current thread */
-            ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                camera->getReconstructionFilter());
-
-            /* Create a clone of the sampler for the current thread */
-            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
-
-            for (int i=range.begin(); i<range.end(); ++i) {
-                /* Request an image block from the block generator */
-                blockGenerator.next(block);
-
-                /* Inform the sampler about the block to be rendered */
-                sampler->prepare(block);
-
-                /* Render all contained pixels */
-                renderBlock(scene, sampler.get(), block);
-
-                /* The image block has been processed. Now add it to
-                   the "big" block that represents the entire image */
-                result.put(block);
+        Timer timer, checkpointTimer;
+
+        if (!coordinatorAddress.empty()) {
+            /* Let the worker processes do the actual rendering */
+            try {
+                renderCoordinator(scene, coordinatorAddress, result, samplesDone, passSize);
+                samplesDone = sampleCount;
+            } catch (const std::exception &e) {
+                /* The image is incomplete, don't save it */
+                coordinatorError = e.what();
+                return;
             }
-        };
-
-        /// Default: parallel rendering
-        tbb::parallel_for(range, map);
+        }
 
-        /// (equivalent to the following single-threaded call)
-        // map(range);
+        renderImage(scene, result, samplesDone, sampleCount, passSize, deterministic, [&](size_t samplesDone) {
+            /* Periodically save the accumulated film. Rendering is paused
+               at this point, so the image is in a consistent state */
+            if (checkpointInterval >= 0 && samplesDone < sampleCount &&
+                checkpointTimer.elapsed() >= 1000.0 * checkpointInterval) {
+                try {
+                    saveCheckpoint(checkpointPath, scene, result, samplesDone);
+                } catch (const std::exception &e) {
+                    cerr << "Could not write a checkpoint: " << e.what() << endl;
+                }
+                checkpointTimer.reset();
+            }
+        });
 
         cout << "done. (took " << timer.elapsedString() << ")" << endl;
     });
@@ -130,26 +145,44 @@ static void render(Scene *scene, const std::string &filename) {
         nanogui::shutdown();
     }
 
+    if (!coordinatorError.empty())
+        throw NoriException("Distributed rendering failed: %s", coordinatorError);
+
     /* Now turn the rendered image block into
        a properly normalized bitmap */
     std::unique_ptr<Bitmap> bitmap(result.toBitmap());
 
-    /* Determine the filename of the output bitmap */
-    std::string outputName = filename;
-    size_t lastdot = outputName.find_last_of(".");
-    if (lastdot != std::string::npos)
-        outputName.erase(lastdot, std::string::npos);
+    if (mergeTarget) {
+        /* Keep everything outside of the crop window from the earlier render.
+           (The reconstruction filter also spreads some samples beyond the
+           window, but these pixels are incomplete and thus discarded) */
+        Point2i offset = camera->getCropOffset();
+        Vector2i size = camera->getCropSize();
+        mergeTarget->block(offset.y(), offset.x(), size.y(), size.x()) =
+            bitmap->block(offset.y(), offset.x(), size.y(), size.x());
+        bitmap = std::move(mergeTarget);
+    }
 
     /* Save using the OpenEXR format */
     bitmap->saveEXR(outputName);
 
     /* Save tonemapped (sRGB) output using the PNG format */
     bitmap->savePNG(outputName);
+
+    /* The render is complete, a stale checkpoint would only
+       cause the next run with --resume to skip all work */
+    if (checkpointInterval >= 0 || resume)
+        std::remove(checkpointPath.c_str());
 }
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N]" <<  endl;
+        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N] [--spp-per-pass N] [--deterministic]" << endl
+             << "       [--crop X Y WIDTH HEIGHT] [--merge FILE.exr]" << endl
+             << "       [--checkpoint-interval SECONDS] [--checkpoint FILE] [--resume]" << endl
+             << "       [--coordinator ADDRESS | --worker ADDRESS]" << endl
+             << "   or: " << argv[0] << " --server ADDRESS [--threads N]" << endl
+             << "ADDRESS is either host:port, :port or unix:/path/to/socket" << endl;
         return -1;
     }
 
@@ -176,6 +209,73 @@ int main(int argc, char **argv) {
             gui = false;
             continue;
         }
+        else if (token == "--deterministic") {
+            deterministic = true;
+            continue;
+        }
+        else if (token == "--crop") {
+            if (i+4 >= argc) {
+                cerr << "\"--crop\" argument expects the offset and size of the window (X Y WIDTH HEIGHT)." << endl;
+                return -1;
+            }
+            cropOffset = Point2i(atoi(argv[i+1]), atoi(argv[i+2]));
+            cropSize = Vector2i(atoi(argv[i+3]), atoi(argv[i+4]));
+            crop = true;
+            i += 4;
+            continue;
+        }
+        else if (token == "--merge") {
+            if (i+1 >= argc) {
+                cerr << "\"--merge\" argument expects an OpenEXR filename following it." << endl;
+                return -1;
+            }
+            mergeName = argv[i+1];
+            i++;
+            continue;
+        }
+        else if (token == "--spp-per-pass") {
+            if (i+1 >= argc || (sppPerPass = atoi(argv[i+1])) <= 0) {
+                cerr << "\"--spp-per-pass\" argument expects a positive integer following it." << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--checkpoint-interval") {
+            if (i+1 >= argc || (checkpointInterval = atof(argv[i+1])) < 0) {
+                cerr << "\"--checkpoint-interval\" argument expects a non-negative number of seconds following it." << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--checkpoint") {
+            if (i+1 >= argc) {
+                cerr << "\"--checkpoint\" argument expects a filename following it." << endl;
+                return -1;
+            }
+            checkpointName = argv[i+1];
+            if (checkpointInterval < 0)
+                checkpointInterval = 600;
+            i++;
+            continue;
+        }
+        else if (token == "--coordinator" || token == "--worker" || token == "--server") {
+            if (i+1 >= argc) {
+                cerr << "\"" << token << "\" argument expects an address following it." << endl;
+                return -1;
+            }
+            (token == "--worker" ? workerAddress :
+             token == "--server" ? serverAddress : coordinatorAddress) = argv[i+1];
+            i++;
+            continue;
+        }
+        else if (token == "--resume") {
+            resume = true;
+            if (checkpointInterval < 0)
+                checkpointInterval = 600;
+            continue;
+        }
 
         filesystem::path path(argv[i]);
 
@@ -200,6 +300,28 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (!coordinatorAddress.empty() && (!workerAddress.empty() || checkpointInterval >= 0)) {
+        cerr << "\"--coordinator\" cannot be combined with \"--worker\" or checkpointing." << endl;
+        return -1;
+    }
+
+    if (!serverAddress.empty()) {
+        /* Scenes are specified by the render requests */
+        if (sceneName != "" || exrName != "") {
+            cerr << "\"--server\" does not accept a scene or image file." << endl;
+            return -1;
+        }
+        if (threadCount < 0)
+            threadCount = tbb::task_scheduler_init::automatic;
+        try {
+            runServer(serverAddress, threadCount);
+        } catch (const std::exception &e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
     if (exrName !="" && sceneName !="") {
         cerr << "Both .xml and .exr files were provided. Please only provide one of them." << endl;
         return -1;
@@ -234,8 +356,18 @@ int main(int argc, char **argv) {
         try {
             std::unique_ptr<NoriObject> root(loadFromXML(sceneName));
             /* When the XML root object is a scene, start rendering it .. */
-            if (root->getClassType() == NoriObject::EScene)
-                render(static_cast<Scene *>(root.get()), sceneName);
+            if (root->getClassType() == NoriObject::EScene) {
+                Scene *scene = static_cast<Scene *>(root.get());
+                if (crop)
+                    scene->getCamera()->setCropWindow(cropOffset, cropSize);
+                if (!workerAddress.empty()) {
+                    /* .. or render parts of it on behalf of a coordinator */
+                    scene->getIntegrator()->preprocess(scene);
+                    runWorker(scene, workerAddress, threadCount);
+                } else {
+                    render(scene, sceneName);
+                }
+            }
         } catch (const std::exception &e) {
             cerr << e.what() << endl;
             return -1;
@@ -18,10 +18,14 @@ Mesh::Mesh() { }
 Mesh::~Mesh() {
     delete m_bsdf;
     delete m_emitter;
+    delete m_interior;
+    delete m_exterior;
 }
 
 void Mesh::activate() {
-    if (!m_bsdf) {
+    /* Meshes that only bound media may go without a BSDF, rays pass
+       through them as if the boundary was index-matched */
+    if (!m_bsdf && !hasMediumInterface()) {
         /* If no material was assigned, instantiate a diffuse BRDF */
         m_bsdf = static_cast<BSDF *>(
             NoriObjectFactory::createInstance("diffuse", PropertyList()));
@@ -32,7 +36,7 @@ void Mesh::activate() {
     }
 
     auto face_count = this->getTriangleCount();
-  	m_dpdf = std::make_shared<DiscretePDF>(face_count);
+  	m_dpdf = std::make_shared<AliasDiscretePDF>(face_count);
 	for (uint32_t face_index = 0; face_index < face_count; ++face_index) {
 	  	m_dpdf->append(this->surfaceArea(face_index));
 	}
@@ -100,6 +104,23 @@ Point3f Mesh::getCentroid(uint32_t index) const {
          m_V.col(m_F(2, index)));
 }
 
+void Mesh::samplePosition(uint32_t index, const Point2f &sample, Point3f &p, Vector3f &n) const {
+    float alpha = 1.f - std::sqrt(1.f - sample.x());
+    float beta = sample.y() * std::sqrt(1.f - sample.x());
+    getPosition(index, Vector3f(alpha, beta, 1.f - alpha - beta), p, n);
+}
+
+void Mesh::getPosition(uint32_t index, const Vector3f &bary, Point3f &p, Vector3f &n) const {
+    uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
+    Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
+    p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
+    if (m_N.size() > 0) {
+        n = (bary.x() * m_N.col(i0) + bary.y() * m_N.col(i1) + bary.z() * m_N.col(i2)).normalized();
+    } else {
+        n = (p1 - p0).cross(p2 - p0).normalized();
+    }
+}
+
 void Mesh::addChild(NoriObject *obj) {
     switch (obj->getClassType()) {
         case EBSDF:
@@ -118,12 +139,36 @@ void Mesh::addChild(NoriObject *obj) {
             }
             break;
 
+        case EMedium:
+            throw NoriException("Mesh: media must be named \"interior\" or \"exterior\"!");
+
         default:
             throw NoriException("Mesh::addChild(<%s>) is not supported!",
                                 classTypeName(obj->getClassType()));
     }
 }
 
+void Mesh::addNamedChild(const std::string &name, NoriObject *obj) {
+    if (obj->getClassType() != EMedium)
+        throw NoriException("Mesh::addNamedChild(<%s>) is not supported!",
+                            classTypeName(obj->getClassType()));
+
+    if (name != "interior" && name != "exterior")
+        throw NoriException("Mesh: unknown medium \"%s\" (expected \"interior\" or \"exterior\")!", name);
+
+    Medium *medium = static_cast<Medium *>(obj);
+    Medium *&target = name == "interior" ? m_interior : m_exterior;
+    if (target)
+        throw NoriException("Mesh: tried to register multiple %s media!", name);
+    target = medium;
+    m_mediumInterface = MediumInterface(m_interior, m_exterior);
+}
+
+void Mesh::setDefaultMedium(const Medium *medium) {
+    m_mediumInterface = MediumInterface(m_interior ? m_interior : medium,
+                                        m_exterior ? m_exterior : medium);
+}
+
 Color3f Mesh::getEmission(const Intersection& its, const Vector3f &wr) const {
 	if (!this->isEmitter()) return Color3f(0);
 	if (its.shFrame.n.dot(wr) < 0) return Color3f(0);
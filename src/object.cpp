@@ -14,6 +14,12 @@ void NoriObject::addChild(NoriObject *) {
         classTypeName(getClassType()));
 }
 
+void NoriObject::addNamedChild(const std::string &name, NoriObject *) {
+    throw NoriException(
+        "NoriObject::addNamedChild(\"%s\") is not implemented for objects of type '%s'!",
+        name, classTypeName(getClassType()));
+}
+
 void NoriObject::activate() { /* Do nothing */ }
 void NoriObject::setParent(NoriObject *) { /* Do nothing */ }
 
@@ -138,6 +138,26 @@ bool Octree::RayIntersect(Ray3f &ray,
   return intersectChild;
 }
 
+bool Octree::RayIntersectAll(const Ray3f &ray, const HitCallback &callback) const {
+  if (this->facesIndices_.size() > 0) {
+	// leaf node. Faces that overlap several leaves are reported once per leaf
+	for (const auto &faces : this->facesIndices_) {
+	  auto[mesh_index, face_index] = ParseFaceIndex(faces);
+	  float u, v, t;
+	  if (meshes_[mesh_index]->rayIntersect(face_index, ray, u, v, t) &&
+		  !callback(meshes_[mesh_index], face_index, t))
+		return false;
+	}
+	return true;
+  }
+
+  for (auto child : this->children_) {
+	if (child->bbox_.rayIntersect(ray) && !child->RayIntersectAll(ray, callback))
+	  return false;
+  }
+  return true;
+}
+
 std::string Octree::ToString() const {
   std::string str;
   int interior_node_num = 0;
@@ -162,17 +162,21 @@ NoriObject *loadFromXML(const std::string &filename) {
             transform.setIdentity();
 
         PropertyList propList;
-        std::vector<NoriObject *> children;
+        std::vector<std::pair<std::string, NoriObject *>> children;
         for (pugi::xml_node &ch: node.children()) {
             NoriObject *child = parseTag(ch, propList, tag);
             if (child)
-                children.push_back(child);
+                children.push_back(std::make_pair(ch.attribute("name").value(), child));
         }
 
         NoriObject *result = nullptr;
         try {
             if (currentIsObject) {
-                check_attributes(node, { "type" });
+                /* Objects may be given a name, which tells their parent what they are used for */
+                if (node.attribute("name"))
+                    check_attributes(node, { "type", "name" });
+                else
+                    check_attributes(node, { "type" });
 
                 /* This is an object, first instantiate it */
                 result = NoriObjectFactory::createInstance(
@@ -191,8 +195,11 @@ NoriObject *loadFromXML(const std::string &filename) {
 
                 /* Add all children */
                 for (auto ch: children) {
-                    result->addChild(ch);
-                    ch->setParent(result);
+                    if (ch.first.empty())
+                        result->addChild(ch.second);
+                    else
+                        result->addNamedChild(ch.first, ch.second);
+                    ch.second->setParent(result);
                 }
 
                 /* Activate / configure the object */
@@ -27,7 +27,7 @@ private:
   Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray, bool includeEmitter) const {
 	Intersection its;
 	if (!scene->rayIntersect(ray, its)) {
-	  return Color3f(0);
+	  return includeEmitter ? scene->evalEnvironment(ray) : Color3f(0);
 	}
 
 	Color3f L_e(0.f);
@@ -41,14 +41,14 @@ private:
 
 	Color3f L_dir(0);
 	if(its.mesh->getBSDF()->isDiffuse()) {
-	  auto lights = scene->getEmitters();
-	  Emitter *pLight = lights[std::rand() % lights.size()]->getEmitter();
+	  float lightPdf;
+	  const Emitter *pLight = scene->sampleEmitter(sampler->next1D(), lightPdf);
 	  EmitterQueryRecord eRec;
 	  Color3f l_i = pLight->sample(its.p, eRec, sampler->next2D());
 	  Vector3f wi = (eRec.point - its.p).normalized();
 	  if (scene->illuminatedEachOther(its.p, eRec.point)) {
 		BSDFQueryRecord sampleLightRecord(its.shFrame.toLocal(-ray.d), its.shFrame.toLocal(wi),  ESolidAngle, sampler);
-		L_dir = l_i * its.mesh->getBSDF()->eval(sampleLightRecord) * std::max(0.f, its.shFrame.n.dot(wi)) * lights.size() / 0.95f;
+		L_dir = l_i * its.mesh->getBSDF()->eval(sampleLightRecord) * std::max(0.f, its.shFrame.n.dot(wi)) / lightPdf / 0.95f;
 	  }
 	}
 
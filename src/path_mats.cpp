@@ -19,7 +19,7 @@ public:
         /* Find the surface that is visible in the requested direction */
         Intersection its;
         if (!scene->rayIntersect(ray, its)) {
-            return Color3f(0);
+            return scene->evalEnvironment(ray);
         }
 
         Color3f sampleColor = its.mesh->getEmission(its, -ray.d);
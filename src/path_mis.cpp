@@ -27,7 +27,7 @@ private:
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray, bool includeEmitter) const {
         Intersection its;
         if (!scene->rayIntersect(ray, its)) {
-            return Color3f(0);
+            return includeEmitter ? scene->evalEnvironment(ray) : Color3f(0);
         }
 
         Color3f L_e(0.f);
@@ -45,20 +45,21 @@ private:
             float sampleLightProbability = 0.5f;
             if (sampler->next1D() < sampleLightProbability) {
                 // sample light
-                auto lights = scene->getEmitters();
-                Emitter *pLight = lights[std::rand() % lights.size()]->getEmitter();
+                float lightSample = sampler->next1D();
+                Point2f positionSample = sampler->next2D();
+                float pdfLight;
                 EmitterQueryRecord eRec;
-                pLight->sample(its.p, eRec, sampler->next2D());
-                if (scene->illuminatedEachOther(its.p, eRec.point)) {
+                const Emitter *pLight = scene->sampleEmitterPosition(its.p, its.shFrame.n, lightSample,
+                                                                     positionSample, eRec, pdfLight);
+                if (pLight && eRec.normal.dot(its.p - eRec.point) > 0 &&
+                    scene->illuminatedEachOther(its.p, eRec.point)) {
                     Vector3f wi = (eRec.point - its.p).normalized();
-                    float pdfLight =
-                            pLight->pdf(eRec) * (eRec.point - its.p).squaredNorm() / std::fabsf(eRec.normal.dot(-wi));
                     BSDFQueryRecord sampleLightRecord(its.shFrame.toLocal(-ray.d), its.shFrame.toLocal(wi),
                                                       ESolidAngle, sampler);
                     float pdfBSDF = its.mesh->getBSDF()->pdf(sampleLightRecord);
                     L_dir = pLight->eval(eRec) *
                             its.mesh->getBSDF()->eval(sampleLightRecord) * std::max(0.f, its.shFrame.n.dot(wi))
-                            * lights.size() / 0.95f /
+                            / 0.95f /
                             (sampleLightProbability * pdfLight + (1 - sampleLightProbability) * pdfBSDF);
                 }
             } else {
@@ -70,10 +71,16 @@ private:
                 Ray3f nextRay(its.p, its.shFrame.toWorld(sampleBRDFRecord.wo), Epsilon,
                               std::numeric_limits<float>::infinity());
                 Intersection itsNext;
-                if (scene->rayIntersect(nextRay, itsNext) && itsNext.mesh->isEmitter()) {
-                    Vector3f wi = (itsNext.p - its.p).normalized();
-                    pdfLight = itsNext.mesh->getEmitter()->pdf(EmitterQueryRecord(itsNext.p, itsNext.shFrame.n)) *
-                               (itsNext.p - its.p).squaredNorm() / std::fabsf(itsNext.shFrame.n.dot(-wi));
+                if (!scene->rayIntersect(nextRay, itsNext)) {
+                    if (scene->getEnvironment()) {
+                        pdfLight = scene->pdfEnvironment(nextRay);
+                        L_dir = scene->evalEnvironment(nextRay) *
+                                std::max(0.f, its.shFrame.n.dot(nextRay.d)) *
+                                its.mesh->getBSDF()->eval(sampleBRDFRecord) / 0.95f /
+                                (sampleLightProbability * pdfLight + (1 - sampleLightProbability) * pdfBSDF);
+                    }
+                } else if (itsNext.mesh->isEmitter() && itsNext.shFrame.n.dot(-nextRay.d) > 0) {
+                    pdfLight = scene->pdfEmitterPosition(its.p, its.shFrame.n, itsNext);
                     L_dir = itsNext.mesh->getEmitter()->eval(EmitterQueryRecord(itsNext.p, itsNext.shFrame.n)) *
                             std::max(0.f, its.shFrame.n.dot(nextRay.d)) *
                             its.mesh->getBSDF()->eval(sampleBRDFRecord) / 0.95f /
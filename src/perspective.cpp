@@ -25,6 +25,12 @@ public:
         m_outputSize.y() = propList.getInteger("height", 720);
         m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
 
+        /* Optional crop window in pixels. Default: the entire image */
+        setCropWindow(
+            Point2i(propList.getInteger("cropOffsetX", 0), propList.getInteger("cropOffsetY", 0)),
+            Vector2i(propList.getInteger("cropWidth", m_outputSize.x()),
+                     propList.getInteger("cropHeight", m_outputSize.y())));
+
         /* Specifies an optional camera-to-world transformation. Default: none */
         m_cameraToWorld = propList.getTransform("toWorld", Transform());
 
@@ -116,12 +122,15 @@ public:
             "PerspectiveCamera[\n"
             "  cameraToWorld = %s,\n"
             "  outputSize = %s,\n"
+            "  crop = %s + %s,\n"
             "  fov = %f,\n"
             "  clip = [%f, %f],\n"
             "  rfilter = %s\n"
             "]",
             indent(m_cameraToWorld.toString(), 18),
             m_outputSize.toString(),
+            m_cropOffset.toString(),
+            m_cropSize.toString(),
             m_fov,
             m_nearClip,
             m_farClip,
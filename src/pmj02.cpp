@@ -0,0 +1,123 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/lowdiscrepancy.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Progressive multi-jittered (0, 2) sampler
+ *
+ * Every 2D (and 1D) request is answered from a precomputed progressive
+ * multi-jittered (0, 2) sequence: any prefix of 2^k samples is stratified
+ * in all elementary intervals of area 2^-k (in particular in 1D and on
+ * square grids), so the sampler does not need to know the final sample
+ * count. This matters for progressive and adaptive rendering.
+ *
+ * The sequences are generated as shuffled and Owen-scrambled 2D Sobol
+ * points, which have exactly the pmj02 stratification properties. They are
+ * stored in a table that is shared read-only between all clones of the
+ * sampler. Each pixel and dimension selects one of the sets and applies a
+ * random digital shift (an XOR of the fixed-point coordinates), which
+ * decorrelates pixels without affecting the stratification.
+ */
+class PMJ02Sampler : public Sampler {
+public:
+    /// Number of precomputed sequences
+    static const uint32_t SetCount = 64;
+    /// Number of points per sequence (must be a power of two)
+    static const uint32_t SetSize = 4096;
+
+    PMJ02Sampler(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Seed for the table and the per-pixel shifts, changes the noise pattern */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+
+        m_table = generateTable(m_seed);
+    }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<PMJ02Sampler> cloned(new PMJ02Sampler());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_table = m_table; /* Shared, not copied */
+        cloned->m_pixelHash = m_pixelHash;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixelHash = hashCombine(
+            hashCombine((uint64_t) (uint32_t) pixel.x(), (uint64_t) (uint32_t) pixel.y()), m_seed);
+        m_sampleIndex = m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        return next2D().x();
+    }
+
+    Point2f next2D() {
+        uint64_t hash = hashCombine(m_pixelHash, m_dimension++);
+
+        /* Continue with another set once a sequence is exhausted */
+        uint64_t set = (hash + m_sampleIndex / SetSize) % SetCount;
+        const uint32_t *point = &(*m_table)[2 * (set * SetSize + m_sampleIndex % SetSize)];
+
+        uint64_t shift = mixBits(hash);
+        return Point2f(
+            bitsToFloat(point[0] ^ (uint32_t) shift),
+            bitsToFloat(point[1] ^ (uint32_t) (shift >> 32))
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format("PMJ02Sampler[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    PMJ02Sampler() { }
+
+    /// Compute \c SetCount sequences of \c SetSize fixed-point 2D points
+    static std::shared_ptr<const std::vector<uint32_t>> generateTable(uint32_t seed) {
+        std::shared_ptr<std::vector<uint32_t>> table =
+            std::make_shared<std::vector<uint32_t>>(2 * SetCount * SetSize);
+        for (uint32_t set = 0; set < SetCount; ++set) {
+            uint64_t hash = hashCombine(seed, set);
+            uint32_t shuffleSeed = (uint32_t) hash;
+            uint32_t scrambleX = (uint32_t) hashCombine(hash, 0);
+            uint32_t scrambleY = (uint32_t) hashCombine(hash, 1);
+            for (uint32_t i = 0; i < SetSize; ++i) {
+                uint32_t index = owenScramble(i, shuffleSeed);
+                uint32_t *point = &(*table)[2 * (set * SetSize + i)];
+                point[0] = owenScramble(sobolSample(index, 0), scrambleX);
+                point[1] = owenScramble(sobolSample(index, 1), scrambleY);
+            }
+        }
+        return table;
+    }
+
+private:
+    uint32_t m_seed = 0;
+    std::shared_ptr<const std::vector<uint32_t>> m_table;
+    uint64_t m_pixelHash = 0;
+    uint64_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(PMJ02Sampler, "pmj02");
+NORI_NAMESPACE_END
@@ -0,0 +1,107 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/render.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <nori/sampler.h>
+#include <nori/integrator.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+NORI_NAMESPACE_BEGIN
+
+void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block, size_t sampleCount) {
+    /* Clear the block contents */
+    block.clear();
+
+    scene->getIntegrator()->renderBlock(scene, sampler, block, sampleCount);
+}
+
+void renderImage(const Scene *scene, ImageBlock &result, size_t firstSample,
+                 size_t sampleCount, size_t passSize, bool deterministic,
+                 const std::function<void(size_t)> &passCallback) {
+    const Camera *camera = scene->getCamera();
+    const Integrator *integrator = scene->getIntegrator();
+    Vector2i outputSize = camera->getOutputSize();
+    int blocksX = (outputSize.x() + NORI_BLOCK_SIZE - 1) / NORI_BLOCK_SIZE;
+    int blocksY = (outputSize.y() + NORI_BLOCK_SIZE - 1) / NORI_BLOCK_SIZE;
+
+    for (size_t samplesDone = firstSample; samplesDone < sampleCount; ) {
+        size_t passSamples = std::min(integrator->getPassSize(samplesDone, passSize),
+                                      sampleCount - samplesDone);
+
+        /* Create a block generator (i.e. a work scheduler) */
+        BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE,
+            camera->getCropOffset(), camera->getCropSize());
+
+        tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
+
+        /* Blocks overlap in their borders, and the order in which floating
+           point values are accumulated there depends on the scheduling. In
+           deterministic mode, the blocks are kept and merged in scanline order
+           once the pass is complete */
+        std::vector<std::unique_ptr<ImageBlock>> finished(
+            deterministic ? blocksX * blocksY : 0);
+
+        auto map = [&](const tbb::blocked_range<int> &range) {
+            /* Allocate memory for a small image block to be rendered
+               by the current thread */
+            std::unique_ptr<ImageBlock> block(new ImageBlock(Vector2i(NORI_BLOCK_SIZE),
+                camera->getReconstructionFilter()));
+
+            /* Create a clone of the sampler for the current thread */
+            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+            sampler->setSampleOffset(samplesDone);
+
+            for (int i=range.begin(); i<range.end(); ++i) {
+                if (!block)
+                    block.reset(new ImageBlock(Vector2i(NORI_BLOCK_SIZE),
+                        camera->getReconstructionFilter()));
+
+                /* Request an image block from the block generator */
+                blockGenerator.next(*block);
+
+                /* Inform the sampler about the block to be rendered */
+                sampler->prepare(*block);
+
+                /* Render all contained pixels */
+                renderBlock(scene, sampler.get(), *block, passSamples);
+
+                if (deterministic) {
+                    /* Hand the block over, it is merged after the pass */
+                    Point2i index = block->getOffset() / NORI_BLOCK_SIZE;
+                    finished[index.y() * blocksX + index.x()] = std::move(block);
+                    continue;
+                }
+
+                /* The image block has been processed. Now add it to
+                   the "big" block that represents the entire image */
+                result.put(*block);
+            }
+        };
+
+        /// Default: parallel rendering
+        tbb::parallel_for(range, map);
+
+        /// (equivalent to the following single-threaded call)
+        // map(range);
+
+        for (auto &block : finished)
+            if (block)
+                result.put(*block);
+
+        samplesDone += passSamples;
+
+        integrator->finishPass(scene, passSamples, samplesDone);
+
+        if (passCallback)
+            passCallback(samplesDone);
+    }
+}
+
+NORI_NAMESPACE_END
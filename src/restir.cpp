@@ -0,0 +1,317 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+#include <nori/emitter.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <nori/hash.h>
+#include <pcg32.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Direct illumination with reservoir-based spatiotemporal importance
+ * resampling (ReSTIR, Bitterli et al. 2020), without the temporal part
+ *
+ * At the first intersection of every camera ray, \c candidates light samples
+ * are drawn with \ref Scene::sampleEmitterPosition(). A single one of them is
+ * kept in a weighted reservoir, chosen proportionally to its unshadowed
+ * contribution divided by its density. If \c spatialReuse is enabled, each
+ * pixel then also resamples the reservoirs of up to \c neighbors random
+ * pixels within \c radius of it in the same image block, provided that
+ * their surfaces are similar. Only the finally chosen sample is tested for
+ * visibility, so each camera sample traces exactly one shadow ray.
+ *
+ * Only direct illumination at the first intersection is computed, which
+ * is zero on purely specular surfaces. Light samples are represented by
+ * area densities, which makes them valid at every shading point. Samples
+ * of the environment are represented by directions. The combination of
+ * reservoirs uses the 1/Z normalization of the paper, so the estimator
+ * stays unbiased.
+ */
+class ReSTIRIntegrator : public Integrator {
+public:
+    ReSTIRIntegrator(const PropertyList &props) {
+        /* Number of candidate light samples per camera sample */
+        m_candidates = props.getInteger("candidates", 32);
+
+        /* Resample the reservoirs of neighboring pixels? */
+        m_spatialReuse = props.getBoolean("spatialReuse", true);
+
+        /* Number of neighboring pixels that are resampled */
+        m_neighbors = props.getInteger("neighbors", 4);
+
+        /* Radius (in pixels) of the neighborhood */
+        m_radius = props.getInteger("radius", 8);
+
+        if (m_candidates < 1 || m_neighbors < 0 || m_radius < 1)
+            throw NoriException("ReSTIRIntegrator: invalid parameters");
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        ShadingPoint sp;
+        Color3f L = initialize(scene, sampler, ray, sp);
+        if (sp.valid)
+            L += shade(scene, sp, sp.reservoir, sp.reservoir.W);
+        return L;
+    }
+
+    void renderBlock(const Scene *scene, Sampler *sampler,
+                     ImageBlock &block, size_t sampleCount) const {
+        if (!m_spatialReuse || m_neighbors == 0) {
+            Integrator::renderBlock(scene, sampler, block, sampleCount);
+            return;
+        }
+
+        const Camera *camera = scene->getCamera();
+        Point2i offset = block.getOffset();
+        Vector2i size = block.getSize();
+        std::vector<ShadingPoint> points(size.x() * size.y());
+        std::vector<Color3f> values(size.x() * size.y());
+        std::vector<Point2f> pixelSamples(size.x() * size.y());
+
+        /* The pixels are processed in lockstep, so every pixel needs its own sampler */
+        std::vector<std::unique_ptr<Sampler>> samplers(size.x() * size.y());
+        for (int y = 0; y < size.y(); ++y) {
+            for (int x = 0; x < size.x(); ++x) {
+                samplers[y * size.x() + x] = sampler->clone();
+                samplers[y * size.x() + x]->generate(Point2i(x + offset.x(), y + offset.y()));
+            }
+        }
+
+        for (uint32_t i = 0; i < sampleCount; ++i) {
+            /* 1. Trace the camera rays and fill the per-pixel reservoirs */
+            for (int y = 0; y < size.y(); ++y) {
+                for (int x = 0; x < size.x(); ++x) {
+                    int index = y * size.x() + x;
+                    Sampler *pixelSampler = samplers[index].get();
+                    Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + pixelSampler->next2D();
+                    Point2f apertureSample = pixelSampler->next2D();
+                    Ray3f ray;
+                    Color3f weight = camera->sampleRay(ray, pixelSample, apertureSample);
+                    values[index] = weight * initialize(scene, pixelSampler, ray, points[index]);
+                    points[index].weight = weight;
+                    pixelSamples[index] = pixelSample;
+                    pixelSampler->advance();
+                }
+            }
+
+            /* 2. Resample the reservoirs of neighboring pixels and shade */
+            uint64_t sampleIndex = sampler->getSampleOffset() + i;
+            for (int y = 0; y < size.y(); ++y) {
+                for (int x = 0; x < size.x(); ++x) {
+                    int index = y * size.x() + x;
+                    const ShadingPoint &sp = points[index];
+                    if (sp.valid) {
+                        uint64_t hash = hashCombine(hashCombine(
+                            (uint64_t) (uint32_t) (x + offset.x()), (uint64_t) (uint32_t) (y + offset.y())), sampleIndex);
+                        pcg32 random(mixBits(hash), hash);
+                        values[index] += sp.weight * spatialReuse(scene, points, size, x, y, random);
+                    }
+                    block.put(pixelSamples[index], values[index]);
+                }
+            }
+        }
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "ReSTIRIntegrator[\n"
+            "  candidates = %i,\n"
+            "  spatialReuse = %s,\n"
+            "  neighbors = %i,\n"
+            "  radius = %i\n"
+            "]",
+            m_candidates, m_spatialReuse ? "true" : "false", m_neighbors, m_radius);
+    }
+
+protected:
+    /// Light sample held by a reservoir
+    struct LightSample {
+        const Emitter *emitter = nullptr;
+        /// Point and normal on the emitter (or direction towards the environment)
+        EmitterQueryRecord eRec;
+    };
+
+    /// Weighted reservoir that holds a single light sample
+    struct Reservoir {
+        LightSample sample;
+        /// Sum of the resampling weights
+        float weightSum = 0.f;
+        /// Number of candidates that were seen
+        float count = 0.f;
+        /// Unbiased contribution weight of the sample
+        float W = 0.f;
+
+        void update(const LightSample &candidate, float weight, float u) {
+            weightSum += weight;
+            if (weight > 0 && u * weightSum < weight)
+                sample = candidate;
+        }
+    };
+
+    /// First intersection of a camera ray together with its reservoir
+    struct ShadingPoint {
+        Intersection its;
+        Vector3f wo;
+        Color3f weight;
+        Reservoir reservoir;
+        bool valid = false;
+    };
+
+    /**
+     * \brief Unshadowed contribution of a light sample to a shading point
+     * with respect to the measure of the sample (area, or solid angle for
+     * the environment)
+     */
+    Color3f contribution(const ShadingPoint &sp, const LightSample &sample) const {
+        if (!sample.emitter)
+            return Color3f(0.f);
+        const Intersection &its = sp.its;
+        EmitterQueryRecord eRec = sample.eRec;
+        Vector3f wi;
+        float geometry;
+        if (sample.emitter->isEnvironment()) {
+            wi = (eRec.point - eRec.ref).normalized();
+            eRec.point = its.p + (eRec.point - eRec.ref);
+            geometry = 1.f;
+        } else {
+            Vector3f d = eRec.point - its.p;
+            float squaredDist = d.squaredNorm();
+            if (squaredDist <= 0)
+                return Color3f(0.f);
+            wi = d / std::sqrt(squaredDist);
+            float cosLight = eRec.normal.dot(-wi);
+            if (cosLight <= 0)
+                return Color3f(0.f);
+            geometry = cosLight / squaredDist;
+        }
+        eRec.ref = its.p;
+
+        BSDFQueryRecord bRec(its.toLocal(sp.wo), its.toLocal(wi), ESolidAngle, nullptr);
+        float cosTheta = std::max(0.f, Frame::cosTheta(bRec.wo));
+        if (cosTheta <= 0)
+            return Color3f(0.f);
+        return sample.emitter->eval(eRec) * its.mesh->getBSDF()->eval(bRec) * cosTheta * geometry;
+    }
+
+    /// Target function of the resampling
+    float target(const ShadingPoint &sp, const LightSample &sample) const {
+        return std::max(0.f, contribution(sp, sample).getLuminance());
+    }
+
+    /**
+     * \brief Trace a camera ray, fill the reservoir of the first intersection
+     * with candidate samples and return the emitted radiance that is seen
+     */
+    Color3f initialize(const Scene *scene, Sampler *sampler, const Ray3f &ray, ShadingPoint &sp) const {
+        sp = ShadingPoint();
+        if (!scene->rayIntersect(ray, sp.its))
+            return scene->evalEnvironment(ray);
+
+        const Intersection &its = sp.its;
+        Color3f L = its.mesh->getEmission(its, -ray.d);
+        sp.wo = -ray.d;
+        sp.valid = true;
+
+        Reservoir &r = sp.reservoir;
+        for (int i = 0; i < m_candidates; ++i) {
+            float emitterSample = sampler->next1D();
+            Point2f positionSample = sampler->next2D();
+            float resampleSample = sampler->next1D();
+            r.count += 1;
+
+            LightSample candidate;
+            float pdf;
+            candidate.emitter = scene->sampleEmitterPosition(its.p, its.shFrame.n, emitterSample,
+                                                             positionSample, candidate.eRec, pdf);
+            if (!candidate.emitter || !(pdf > 0))
+                continue;
+
+            /* Convert the density to the measure of the target function */
+            if (!candidate.emitter->isEnvironment()) {
+                Vector3f d = candidate.eRec.point - its.p;
+                float squaredDist = d.squaredNorm();
+                float cosLight = std::abs(candidate.eRec.normal.dot(d)) / std::sqrt(squaredDist);
+                pdf *= cosLight / squaredDist;
+            }
+
+            float pHat = target(sp, candidate);
+            if (pHat > 0 && pdf > 0)
+                r.update(candidate, pHat / pdf, resampleSample);
+        }
+
+        float pHat = target(sp, r.sample);
+        r.W = pHat > 0 ? r.weightSum / (r.count * pHat) : 0.f;
+        return L;
+    }
+
+    /// Resample the reservoirs of neighboring pixels and shade the pixel (x, y)
+    Color3f spatialReuse(const Scene *scene, const std::vector<ShadingPoint> &points,
+                         const Vector2i &size, int x, int y, pcg32 &random) const {
+        const ShadingPoint &sp = points[y * size.x() + x];
+
+        std::vector<int> sources;
+        sources.reserve(m_neighbors + 1);
+        sources.push_back(y * size.x() + x);
+        for (int i = 0; i < m_neighbors; ++i) {
+            int nx = x + (int) random.nextUInt(2 * m_radius + 1) - m_radius;
+            int ny = y + (int) random.nextUInt(2 * m_radius + 1) - m_radius;
+            if (nx < 0 || ny < 0 || nx >= size.x() || ny >= size.y() ||
+                std::find(sources.begin(), sources.end(), ny * size.x() + nx) != sources.end())
+                continue;
+            const ShadingPoint &neighbor = points[ny * size.x() + nx];
+            /* Only reuse samples from similar surfaces */
+            if (!neighbor.valid || neighbor.its.shFrame.n.dot(sp.its.shFrame.n) < 0.9f ||
+                std::abs(neighbor.its.t - sp.its.t) > 0.1f * sp.its.t)
+                continue;
+            sources.push_back(ny * size.x() + nx);
+        }
+
+        Reservoir combined;
+        for (int source : sources) {
+            const Reservoir &r = points[source].reservoir;
+            combined.count += r.count;
+            combined.update(r.sample, target(sp, r.sample) * r.W * r.count, random.nextFloat());
+        }
+
+        /* Normalize by the number of candidates that could have produced the sample */
+        float pHat = target(sp, combined.sample);
+        if (!(pHat > 0))
+            return Color3f(0.f);
+        float z = 0.f;
+        for (int source : sources)
+            if (target(points[source], combined.sample) > 0)
+                z += points[source].reservoir.count;
+        return shade(scene, sp, combined, combined.weightSum / (z * pHat));
+    }
+
+    /// Trace the shadow ray of the reservoir's sample and return its contribution
+    Color3f shade(const Scene *scene, const ShadingPoint &sp, const Reservoir &r, float W) const {
+        if (!(W > 0))
+            return Color3f(0.f);
+        Point3f target = r.sample.eRec.point;
+        if (r.sample.emitter->isEnvironment())
+            target = sp.its.p + (r.sample.eRec.point - r.sample.eRec.ref);
+        if (!scene->illuminatedEachOther(sp.its.p, target))
+            return Color3f(0.f);
+        return contribution(sp, r.sample) * W;
+    }
+
+private:
+    int m_candidates;
+    bool m_spatialReuse;
+    int m_neighbors;
+    int m_radius;
+};
+
+NORI_REGISTER_CLASS(ReSTIRIntegrator, "restir");
+NORI_NAMESPACE_END
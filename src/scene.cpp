@@ -10,11 +10,30 @@
 #include <nori/sampler.h>
 #include <nori/camera.h>
 #include <nori/emitter.h>
+#include <nori/lowdiscrepancy.h>
+#include <algorithm>
+#include <tuple>
+#include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
+/// Jacobian that converts an area density at \c eRec.point into a solid angle density at \c eRec.ref
+static float areaToSolidAngle(const EmitterQueryRecord &eRec) {
+    Vector3f d = eRec.point - eRec.ref;
+    float squaredDist = d.squaredNorm();
+    float cosTheta = std::abs(eRec.normal.dot(d)) / std::sqrt(squaredDist);
+    return cosTheta > 0 ? squaredDist / cosTheta : 0.f;
+}
+
+Scene::Scene(const PropertyList &propList) {
     m_accel = new Accel();
+
+    /* Strategy for choosing emitters for direct illumination ("power" or "bvh") */
+    std::string emitterSampling = propList.getString("emitterSampling", "power");
+    if (emitterSampling == "bvh")
+        m_useLightBVH = true;
+    else if (emitterSampling != "power")
+        throw NoriException("Scene: unknown emitter sampling strategy \"%s\"", emitterSampling);
 }
 
 Scene::~Scene() {
@@ -22,6 +41,7 @@ Scene::~Scene() {
     delete m_sampler;
     delete m_camera;
     delete m_integrator;
+    delete m_environment;
 }
 
 void Scene::activate() {
@@ -38,6 +58,63 @@ void Scene::activate() {
             NoriObjectFactory::createInstance("independent", PropertyList()));
     }
 
+    if (m_environment)
+        m_environment->build();
+
+    /* Sides of medium boundaries without a medium are part of the scene's medium */
+    for (Mesh *mesh : m_meshes) {
+        if (!mesh->getBSDF() && !m_integrator->supportsMediumBoundaries())
+            throw NoriException("Mesh \"%s\" has no BSDF and only bounds a medium, which "
+                                "is not supported by the chosen integrator", mesh->getName());
+        if (mesh->hasMediumInterface())
+            mesh->setDefaultMedium(m_medium);
+    }
+
+    /* Collect the media whose emission can be sampled */
+    m_emissiveMedia.clear();
+    auto addEmissiveMedium = [&](const Medium *medium) {
+        if (medium && medium->isEmitter() &&
+            std::find(m_emissiveMedia.begin(), m_emissiveMedia.end(), medium) == m_emissiveMedia.end())
+            m_emissiveMedia.push_back(medium);
+    };
+    addEmissiveMedium(m_medium);
+    for (Mesh *mesh : m_meshes) {
+        if (mesh->hasMediumInterface()) {
+            addEmissiveMedium(mesh->getMediumInterface().m_inside);
+            addEmissiveMedium(mesh->getMediumInterface().m_outside);
+        }
+    }
+
+    /* Build a distribution that chooses emitters proportionally to their
+       power. Fall back to a uniform choice if no power is known */
+    m_emitterPDF.clear();
+    m_emitterPDF.reserve(m_emitters.size() + 1);
+    m_emitterIndices.clear();
+    for (size_t i = 0; i < m_emitters.size(); ++i) {
+        const Mesh *mesh = m_emitters[i];
+        m_emitterPDF.append(mesh->getEmitter()->emission().getLuminance() * mesh->getSurfaceArea());
+        m_emitterIndices[mesh->getEmitter()] = i;
+    }
+    if (m_environment) {
+        /* The environment emitter is the last entry. Uniform radiance L
+           from all directions deposits 2 pi^2 r^2 L on a disk with radius r
+           (both sides), compared to pi L A emitted by an area light */
+        BoundingBox3f bbox = getBoundingBox();
+        float radius = bbox.isValid() ? (bbox.max - bbox.getCenter()).norm() : 1.f;
+        m_emitterPDF.append(m_environment->emission().getLuminance() * 2 * M_PI * radius * radius);
+        m_emitterIndices[m_environment] = m_emitters.size();
+    }
+    if (m_emitterPDF.size() > 0 && !(m_emitterPDF.normalize() > 0)) {
+        size_t count = m_emitterPDF.size();
+        m_emitterPDF.clear();
+        for (size_t i = 0; i < count; ++i)
+            m_emitterPDF.append(1.f);
+        m_emitterPDF.normalize();
+    }
+
+    if (m_useLightBVH)
+        m_lightBVH.build(m_emitters);
+
     cout << endl;
     cout << "Configuration: " << toString() << endl;
     cout << endl;
@@ -56,9 +133,12 @@ void Scene::addChild(NoriObject *obj) {
             break;
         
         case EEmitter: {
-                //Emitter *emitter = static_cast<Emitter *>(obj);
-                /* TBD */
-                throw NoriException("Scene::addChild(): You need to implement this for emitters");
+                Emitter *emitter = static_cast<Emitter *>(obj);
+                if (!emitter->isEnvironment())
+                    throw NoriException("Scene::addChild(): area emitters must be attached to a mesh!");
+                if (m_environment)
+                    throw NoriException("There can only be one environment emitter per scene!");
+                m_environment = emitter;
             }
             break;
 
@@ -105,16 +185,93 @@ std::string Scene::toString() const {
         "  integrator = %s,\n"
         "  sampler = %s\n"
         "  camera = %s,\n"
+        "  emitterSampling = %s,\n"
         "  meshes = {\n"
         "  %s  }\n"
         "]",
         indent(m_integrator->toString()),
         indent(m_sampler->toString()),
         indent(m_camera->toString()),
+        m_useLightBVH ? m_lightBVH.toString() : "power",
         indent(meshes, 2)
     );
 }
 
+const Emitter *Scene::sampleEmitter(float sample, float &pdf) const {
+    size_t index = m_emitterPDF.sample(sample, pdf);
+    return index < m_emitters.size() ? m_emitters[index]->getEmitter() : m_environment;
+}
+
+float Scene::pdfEmitter(const Emitter *emitter) const {
+    auto it = m_emitterIndices.find(emitter);
+    return it != m_emitterIndices.end() ? m_emitterPDF[it->second] : 0.f;
+}
+
+const Emitter *Scene::sampleEmitterPosition(const Point3f &ref, const Normal3f &n, float sample,
+                                            const Point2f &positionSample, EmitterQueryRecord &eRec,
+                                            float &pdf) const {
+    if (m_emitterPDF.size() == 0)
+        return nullptr;
+
+    if (!m_useLightBVH) {
+        float emitterPdf;
+        const Emitter *emitter = sampleEmitter(sample, emitterPdf);
+        emitter->sample(ref, eRec, positionSample);
+        eRec.measure = ESolidAngle;
+        pdf = emitterPdf * emitter->pdf(eRec);
+        return emitter;
+    }
+
+    /* Choose between the environment and the light hierarchy */
+    float environmentPdf = m_environment ? pdfEmitter(m_environment) : 0.f;
+    if (sample < environmentPdf) {
+        m_environment->sample(ref, eRec, positionSample);
+        eRec.measure = ESolidAngle;
+        pdf = environmentPdf * m_environment->pdf(eRec);
+        return m_environment;
+    }
+    sample = std::min((sample - environmentPdf) / (1 - environmentPdf), OneMinusEpsilon);
+
+    const Mesh *mesh;
+    uint32_t face;
+    float trianglePmf;
+    if (!m_lightBVH.sample(ref, n, sample, mesh, face, trianglePmf))
+        return nullptr;
+    mesh->samplePosition(face, positionSample, eRec.point, eRec.normal);
+    eRec.ref = ref;
+    eRec.face = face;
+    eRec.measure = ESolidAngle;
+    pdf = (1 - environmentPdf) * trianglePmf / mesh->surfaceArea(face) * areaToSolidAngle(eRec);
+    return mesh->getEmitter();
+}
+
+float Scene::pdfEmitterPosition(const Point3f &ref, const Normal3f &n, const Intersection &its) const {
+    const Emitter *emitter = its.mesh->getEmitter();
+    if (!emitter)
+        return 0.f;
+    EmitterQueryRecord eRec(ref, its.p, its.shFrame.n, its.face);
+    eRec.measure = ESolidAngle;
+    if (!m_useLightBVH)
+        return pdfEmitter(emitter) * emitter->pdf(eRec);
+    float environmentPdf = m_environment ? pdfEmitter(m_environment) : 0.f;
+    return (1 - environmentPdf) * m_lightBVH.pmf(ref, n, its.mesh, its.face)
+        / its.mesh->surfaceArea(its.face) * areaToSolidAngle(eRec);
+}
+
+Color3f Scene::evalEnvironment(const Ray3f &ray) const {
+    if (!m_environment)
+        return Color3f(0.f);
+    return m_environment->eval(EmitterQueryRecord(ray.o, ray.o + ray.d, -ray.d, (uint32_t) -1));
+}
+
+float Scene::pdfEnvironment(const Ray3f &ray) const {
+    if (!m_environment)
+        return 0.f;
+    EmitterQueryRecord eRec(ray.o, ray.o + ray.d, -ray.d, (uint32_t) -1);
+    eRec.measure = ESolidAngle;
+    return pdfEmitter(m_environment) * m_environment->pdf(eRec);
+}
+
 bool Scene::illuminatedEachOther(const Point3f &p0, const Point3f &p1) const {
     Vector3f dir = p1 - p0;
     Ray3f ray(p0, dir.normalized());
@@ -123,20 +280,98 @@ bool Scene::illuminatedEachOther(const Point3f &p0, const Point3f &p1) const {
     return !this->rayIntersect(ray);
 }
 
-bool Scene::rayIntersectTr(const Ray3f &ray, Sampler *sampler,
-                           Intersection &its, Color3f &tr) const {
-    tr = Color3f(1.f);
-    Ray3f r = ray;
-    while (true) {
-        bool hit = rayIntersect(r, its);
-        if (m_medium)
-            tr *= m_medium->tr(r, sampler);
-        if (!hit)
+Color3f Scene::evalTransmittance(const Point3f &p0, const Point3f &p1,
+                                 const Medium *medium, Sampler *sampler,
+                                 const Medium **endMedium) const {
+    Vector3f dir = p1 - p0;
+    float dist = dir.norm();
+    Ray3f ray(p0, dir / dist, Epsilon, dist - Epsilon);
+
+    /* Gather the medium boundaries along the ray in a single traversal.
+       Any surface with a BSDF blocks the ray */
+    struct Crossing {
+        float t;
+        const Mesh *mesh;
+        uint32_t face;
+        bool operator<(const Crossing &c) const {
+            return std::tie(t, mesh, face) < std::tie(c.t, c.mesh, c.face);
+        }
+    };
+    std::vector<Crossing> crossings;
+    bool unoccluded = m_accel->rayIntersectAll(ray, [&](const Mesh *mesh, uint32_t face, float t) {
+        if (mesh->getBSDF())
             return false;
-        if (its.mesh->getBSDF() != nullptr)
-            return true;
-        r = Ray3f(its.p + Epsilon*r.d, r.d);
+        crossings.push_back(Crossing { t, mesh, face });
+        return true;
+    });
+    if (!unoccluded) {
+        if (endMedium)
+            *endMedium = nullptr;
+        return Color3f(0.f);
+    }
+    std::sort(crossings.begin(), crossings.end());
+
+    /* Homogeneous segments only add to the optical depth, other media
+       estimate the transmittance of their segment */
+    Color3f tr(1.f), opticalDepth(0.f);
+    auto addSegment = [&](float t0, float t1) {
+        if (!medium || t1 <= t0)
+            return;
+        if (medium->isHomogeneous())
+            opticalDepth += (medium->sigmaA() + medium->sigmaS()) * (t1 - t0);
+        else
+            tr *= medium->tr(Ray3f(ray.o, ray.d, t0, t1), sampler);
+    };
+
+    float t = 0.f;
+    for (size_t i = 0; i < crossings.size(); ++i) {
+        const Crossing &c = crossings[i];
+        /* Triangles that overlap several nodes of the octree are reported repeatedly */
+        if (i > 0 && c.mesh == crossings[i - 1].mesh && c.face == crossings[i - 1].face)
+            continue;
+        addSegment(t, c.t);
+        t = c.t;
+
+        const MediumInterface &interface = c.mesh->getMediumInterface();
+        if (interface.isMediumTransition()) {
+            const MatrixXf &V = c.mesh->getVertexPositions();
+            const MatrixXu &F = c.mesh->getIndices();
+            Point3f v0 = V.col(F(0, c.face)), v1 = V.col(F(1, c.face)), v2 = V.col(F(2, c.face));
+            Vector3f n = (v1 - v0).cross(v2 - v0);
+            medium = ray.d.dot(n) > 0 ? interface.m_outside : interface.m_inside;
+        }
     }
+    addSegment(t, ray.maxt);
+    if (endMedium)
+        *endMedium = medium;
+
+    if (!opticalDepth.isZero())
+        tr *= Color3f(-opticalDepth).exp();
+    return tr;
+}
+
+Color3f Scene::sampleMediumEmission(const Point3f &sample, Point3f &p,
+                                    const Medium *&medium, float &pdf) const {
+    if (m_emissiveMedia.empty()) {
+        pdf = 0.f;
+        return Color3f(0.f);
+    }
+
+    /* Choose a medium and reuse the sample */
+    size_t count = m_emissiveMedia.size();
+    size_t index = std::min((size_t) (sample.x() * count), count - 1);
+    medium = m_emissiveMedia[index];
+    Point3f reused(sample.x() * count - index, sample.y(), sample.z());
+
+    Color3f emission = medium->sampleEmission(reused, p, pdf);
+    pdf /= count;
+    return emission;
+}
+
+float Scene::pdfMediumEmission(const Medium *medium, const Point3f &p) const {
+    if (!medium || std::find(m_emissiveMedia.begin(), m_emissiveMedia.end(), medium) == m_emissiveMedia.end())
+        return 0.f;
+    return medium->pdfEmission(p) / m_emissiveMedia.size();
 }
 
 NORI_REGISTER_CLASS(Scene, "scene");
@@ -0,0 +1,406 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/server.h>
+#include <nori/socket.h>
+#include <nori/render.h>
+#include <nori/parser.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <nori/sampler.h>
+#include <nori/integrator.h>
+#include <nori/timer.h>
+#include <tbb/task_scheduler_init.h>
+#include <Eigen/Geometry>
+#include <filesystem/resolver.h>
+#include <pugixml.hpp>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    typedef std::map<std::string, std::string> Arguments;
+
+    typedef std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> FileTimes;
+
+    /// Scene that has been parsed (and whose accelerator has been built) before
+    struct CachedScene {
+        /// Modification times of the XML file and of all files that it references
+        FileTimes mtimes;
+        std::unique_ptr<NoriObject> root;
+    };
+
+    /// Have any of the files been modified (or removed) since their times were recorded?
+    bool modified(const FileTimes &mtimes) {
+        for (const auto &entry : mtimes) {
+            std::error_code ec;
+            std::filesystem::file_time_type mtime = std::filesystem::last_write_time(entry.first, ec);
+            if (ec || mtime != entry.second)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * \brief Record the modification times of the XML file and of the files
+     * (meshes, textures, density grids, ..) that its string properties name
+     *
+     * Must be called while the scene's directory is on the search path, so
+     * that the names resolve to the same files as during parsing.
+     */
+    FileTimes sceneFileTimes(const std::filesystem::path &path) {
+        FileTimes mtimes;
+        auto add = [&](const std::filesystem::path &file) {
+            std::error_code ec;
+            std::filesystem::file_time_type mtime = std::filesystem::last_write_time(file, ec);
+            if (!ec)
+                mtimes.emplace_back(file, mtime);
+        };
+        add(path);
+
+        pugi::xml_document doc;
+        if (!doc.load_file(path.string().c_str()))
+            return mtimes;
+        for (pugi::xpath_node node : doc.select_nodes("//string[@value]")) {
+            std::string value = node.node().attribute("value").value();
+            if (value.empty())
+                continue;
+            std::error_code ec;
+            std::filesystem::path file(getFileResolver()->resolve(value).str());
+            if (std::filesystem::is_regular_file(file, ec))
+                add(std::filesystem::canonical(file, ec));
+        }
+        return mtimes;
+    }
+
+    /// Parsed scenes, keyed by the canonical path of their XML file
+    class SceneCache {
+    public:
+        /**
+         * \brief Return the scene stored in \c filename
+         *
+         * The file is only parsed if it is not cached yet or if it or any
+         * file that it references was modified since it was loaded.
+         * \c cached reports which case applied.
+         */
+        Scene *get(const std::string &filename, bool &cached) {
+            std::error_code ec;
+            std::filesystem::path path = std::filesystem::canonical(filename, ec);
+            if (ec)
+                throw NoriException("Scene file \"%s\" not found", filename);
+
+            auto it = m_scenes.find(path.string());
+            if (it != m_scenes.end() && !modified(it->second.mtimes)) {
+                cached = true;
+                return static_cast<Scene *>(it->second.root.get());
+            }
+
+            /* Drop an outdated version before loading the new one */
+            if (it != m_scenes.end())
+                m_scenes.erase(it);
+
+            /* Resolve relative resource paths against the scene's directory,
+               but only while parsing, so that scenes cannot shadow each other */
+            filesystem::resolver *resolver = getFileResolver();
+            resolver->prepend(filesystem::path(path.parent_path().string()));
+            std::unique_ptr<NoriObject> root;
+            FileTimes mtimes;
+            try {
+                /* Record the times first, so that files which are modified
+                   while parsing cause a reload next time */
+                mtimes = sceneFileTimes(path);
+                root.reset(loadFromXML(path.string()));
+            } catch (...) {
+                resolver->erase(resolver->begin());
+                throw;
+            }
+            resolver->erase(resolver->begin());
+
+            if (root->getClassType() != NoriObject::EScene)
+                throw NoriException("\"%s\" does not describe a scene", filename);
+
+            Scene *scene = static_cast<Scene *>(root.get());
+            m_scenes[path.string()] = CachedScene { std::move(mtimes), std::move(root) };
+            cached = false;
+            return scene;
+        }
+
+        /// Remove a scene from the cache. Returns \c false if it was not cached.
+        bool evict(const std::string &filename) {
+            std::error_code ec;
+            std::filesystem::path path = std::filesystem::canonical(filename, ec);
+            return !ec && m_scenes.erase(path.string()) > 0;
+        }
+
+        size_t size() const { return m_scenes.size(); }
+    private:
+        std::map<std::string, CachedScene> m_scenes;
+    };
+
+    /// Restores the parts of a cached scene that a job has overridden
+    class SceneOverride {
+    public:
+        SceneOverride(Scene *scene) : m_scene(scene),
+            m_sampleCount(scene->getSampler()->getSampleCount()) { }
+
+        ~SceneOverride() {
+            m_scene->getSampler()->setSampleCount(m_sampleCount);
+            if (m_camera)
+                delete m_scene->setCamera(m_camera);
+        }
+
+        void setSampleCount(size_t sampleCount) {
+            m_scene->getSampler()->setSampleCount(sampleCount);
+        }
+
+        void setCamera(Camera *camera) {
+            Camera *previous = m_scene->setCamera(camera);
+            if (m_camera)
+                delete previous;
+            else
+                m_camera = previous;
+        }
+    private:
+        Scene *m_scene;
+        size_t m_sampleCount;
+        Camera *m_camera = nullptr;
+    };
+
+    /// Read a line terminated by '\n' (a trailing '\r' is removed)
+    bool readLine(Socket &socket, std::string &line) {
+        line.clear();
+        char c;
+        while (true) {
+            if (!socket.recvAll(&c, 1))
+                return false;
+            if (c == '\n')
+                break;
+            line.push_back(c);
+            if (line.size() > 65536)
+                return false;
+        }
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        return true;
+    }
+
+    bool writeLine(Socket &socket, std::string line) {
+        /* Multi-line error messages must not break the protocol */
+        for (char &c : line)
+            if (c == '\n' || c == '\r')
+                c = ' ';
+        line.push_back('\n');
+        return socket.sendAll(line.data(), line.size());
+    }
+
+    /// Create a perspective camera from the lookat/fov/size arguments of a request
+    Camera *createCamera(const Arguments &args, const Camera *original) {
+        for (const char *name : { "origin", "target", "up" })
+            if (args.find(name) == args.end())
+                throw NoriException("Camera overrides require the \"origin\", \"target\" and \"up\" arguments");
+
+        Vector3f origin = toVector3f(args.at("origin"));
+        Vector3f target = toVector3f(args.at("target"));
+        Vector3f up = toVector3f(args.at("up"));
+
+        /* Same construction as the <lookat> tag of the XML parser */
+        Vector3f dir = (target - origin).normalized();
+        Vector3f left = up.normalized().cross(dir).normalized();
+        Vector3f newUp = dir.cross(left).normalized();
+
+        Eigen::Matrix4f trafo;
+        trafo << left, newUp, dir, origin,
+                  0, 0, 0, 1;
+
+        PropertyList props;
+        props.setTransform("toWorld", Transform(trafo));
+        props.setInteger("width", args.count("width") ? toInt(args.at("width"))
+                                                      : original->getOutputSize().x());
+        props.setInteger("height", args.count("height") ? toInt(args.at("height"))
+                                                        : original->getOutputSize().y());
+        if (args.count("fov"))
+            props.setFloat("fov", toFloat(args.at("fov")));
+
+        std::unique_ptr<NoriObject> camera(NoriObjectFactory::createInstance("perspective", props));
+        camera->activate();
+        return static_cast<Camera *>(camera.release());
+    }
+
+    class Server {
+    public:
+        Server(int threadCount) : m_threadCount(threadCount) { }
+
+        /// Handle all requests of a connection until it is closed
+        void serve(Socket &socket) {
+            std::string line;
+            while (readLine(socket, line)) {
+                std::vector<std::string> tokens = tokenize(line, " \t");
+                if (tokens.empty())
+                    continue;
+
+                std::string reply;
+                try {
+                    Arguments args;
+                    for (size_t i = 1; i < tokens.size(); ++i) {
+                        size_t eq = tokens[i].find('=');
+                        if (eq == std::string::npos)
+                            throw NoriException("Malformed argument \"%s\" (expected key=value)", tokens[i]);
+                        args[tokens[i].substr(0, eq)] = tokens[i].substr(eq + 1);
+                    }
+
+                    const std::string &command = tokens[0];
+                    if (command == "render") {
+                        reply = render(args);
+                    } else if (command == "evict") {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        if (!m_cache.evict(argument(args, "scene")))
+                            throw NoriException("Scene \"%s\" is not cached", args.at("scene"));
+                        reply = "ok";
+                    } else if (command == "ping") {
+                        reply = "ok";
+                    } else if (command == "shutdown") {
+                        /* Let the running job finish first */
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_stop = true;
+                        reply = "ok";
+                    } else {
+                        throw NoriException("Unknown command \"%s\"", command);
+                    }
+                } catch (const std::exception &e) {
+                    reply = std::string("error ") + e.what();
+                }
+
+                if (!writeLine(socket, reply) || m_stop)
+                    break;
+            }
+        }
+
+        bool stopRequested() const { return m_stop; }
+    private:
+        static const std::string &argument(const Arguments &args, const std::string &name) {
+            auto it = args.find(name);
+            if (it == args.end())
+                throw NoriException("Missing argument \"%s\"", name);
+            return it->second;
+        }
+
+        std::string render(const Arguments &args) {
+            const std::string &sceneName = argument(args, "scene");
+
+            /* Determine the filename of the output bitmap */
+            std::string outputName = args.count("out") ? args.at("out") : sceneName;
+            size_t lastdot = outputName.find_last_of(".");
+            if (lastdot != std::string::npos && outputName.find_first_of("/\\", lastdot) == std::string::npos)
+                outputName.erase(lastdot, std::string::npos);
+
+            /* Jobs modify the cached scenes, hence run one at a time */
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Timer timer;
+
+            bool cached;
+            Scene *scene = m_cache.get(sceneName, cached);
+
+            SceneOverride override(scene);
+            if (args.count("spp")) {
+                int spp = toInt(args.at("spp"));
+                if (spp <= 0)
+                    throw NoriException("\"spp\" must be a positive integer");
+                override.setSampleCount((size_t) spp);
+            }
+            if (args.count("origin") || args.count("target") || args.count("up") ||
+                args.count("fov") || args.count("width") || args.count("height"))
+                override.setCamera(createCamera(args, scene->getCamera()));
+
+            cout << "Rendering \"" << sceneName << "\" (" << (cached ? "cached" : "loaded")
+                 << ") .. ";
+            cout.flush();
+
+            tbb::task_scheduler_init init(m_threadCount);
+            scene->getIntegrator()->preprocess(scene);
+
+            const Camera *camera = scene->getCamera();
+            size_t sampleCount = scene->getSampler()->getSampleCount();
+            ImageBlock result(camera->getOutputSize(), camera->getReconstructionFilter());
+            result.clear();
+            /* Repeated jobs produce identical images, so clients can cache and diff them */
+            renderImage(scene, result, 0, sampleCount, sampleCount, true);
+
+            std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+            bitmap->saveEXR(outputName);
+            bitmap->savePNG(outputName);
+
+            cout << "done. (took " << timer.elapsedString() << ")" << endl;
+
+            return tfm::format("ok %s %f %s", outputName, timer.elapsed() / 1000.0,
+                               cached ? "cached" : "loaded");
+        }
+
+        int m_threadCount;
+        SceneCache m_cache;
+        std::mutex m_mutex;
+        std::atomic<bool> m_stop { false };
+    };
+
+    /// A client connection and the thread serving it
+    struct Connection {
+        std::shared_ptr<Socket> socket;
+        std::shared_ptr<std::atomic<bool>> finished;
+        std::thread thread;
+    };
+}
+
+void runServer(const std::string &address, int threadCount) {
+    Server server(threadCount);
+    std::unique_ptr<Socket> listener = Socket::listen(address);
+    cout << "Render server listening on \"" << address << "\"" << endl;
+
+    std::list<Connection> connections;
+    while (!server.stopRequested()) {
+        std::unique_ptr<Socket> socket = listener->accept(100);
+
+        if (socket) {
+            Connection connection;
+            connection.socket = std::shared_ptr<Socket>(std::move(socket));
+            connection.finished = std::make_shared<std::atomic<bool>>(false);
+            std::shared_ptr<Socket> s = connection.socket;
+            std::shared_ptr<std::atomic<bool>> finished = connection.finished;
+            connection.thread = std::thread([s, finished, &server] {
+                server.serve(*s);
+                s->shutdown();
+                *finished = true;
+            });
+            connections.push_back(std::move(connection));
+        }
+
+        /* Reap the threads of closed connections */
+        for (auto it = connections.begin(); it != connections.end(); ) {
+            if (*it->finished) {
+                it->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /* Disconnect the remaining clients. Jobs that were queued behind the
+       shutdown request still run, but their replies are lost */
+    for (auto &connection : connections)
+        connection.socket->shutdown();
+    for (auto &connection : connections)
+        connection.thread.join();
+
+    cout << "Render server stopped." << endl;
+}
+
+NORI_NAMESPACE_END
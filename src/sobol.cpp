@@ -0,0 +1,110 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/lowdiscrepancy.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Owen-scrambled Sobol sampler
+ *
+ * The first four dimensions of each pixel sample (usually the position on
+ * the film and on the aperture) are taken jointly from a 4D Sobol sequence.
+ * All following 1D and 2D requests are padded with independently shuffled
+ * copies of the first Sobol dimensions, which keeps each of them well
+ * stratified across the samples of a pixel.
+ *
+ * Scrambling and shuffling use hash-based Owen permutations that are seeded
+ * per pixel, hence neighboring pixels are decorrelated and each pixel can
+ * be rendered independently of the others. The error decreases fastest for
+ * sample counts that are a power of two.
+ */
+class SobolSampler : public Sampler {
+public:
+    SobolSampler(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Seed for the scrambling, changes the noise pattern */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<SobolSampler> cloned(new SobolSampler());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixelHash = m_pixelHash;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixelHash = hashCombine(
+            hashCombine((uint64_t) (uint32_t) pixel.x(), (uint64_t) (uint32_t) pixel.y()), m_seed);
+        m_sampleIndex = (uint32_t) m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        int dim = nextDimensions(1);
+        return sample(dim, 0);
+    }
+
+    Point2f next2D() {
+        int dim = nextDimensions(2);
+        return Point2f(sample(dim, 0), sample(dim, 1));
+    }
+
+    std::string toString() const {
+        return tfm::format("SobolSampler[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    SobolSampler() { }
+
+    /// Reserve \c count dimensions and return the index of the first one
+    int nextDimensions(int count) {
+        int dim = m_dimension;
+        /* Do not split a 2D request across the 4D block and the padding */
+        if (dim < SobolDimensions && dim + count > SobolDimensions)
+            dim = SobolDimensions;
+        m_dimension = dim + count;
+        return dim;
+    }
+
+    /// Return component \c i of the sample for the dimension(s) starting at \c dim
+    float sample(int dim, int i) const {
+        if (dim < SobolDimensions) {
+            /* Joint 4D Sobol point, all components share the shuffle */
+            uint32_t seed = (uint32_t) m_pixelHash;
+            uint32_t scrambleSeed = (uint32_t) hashCombine(m_pixelHash, dim + i);
+            return sobolOwen(m_sampleIndex, dim + i, seed, scrambleSeed);
+        }
+
+        /* Padding: a separately shuffled (0, 2)-sequence per request */
+        uint64_t hash = hashCombine(m_pixelHash, dim);
+        uint32_t scrambleSeed = (uint32_t) hashCombine(hash, i);
+        return sobolOwen(m_sampleIndex, i, (uint32_t) (hash >> 32), scrambleSeed);
+    }
+
+private:
+    uint32_t m_seed = 0;
+    uint64_t m_pixelHash = 0;
+    uint32_t m_sampleIndex = 0;
+    int m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(SobolSampler, "sobol");
+NORI_NAMESPACE_END
@@ -0,0 +1,247 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/socket.h>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+
+#if !defined(PLATFORM_WINDOWS)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+#if !defined(PLATFORM_WINDOWS)
+
+namespace {
+    /// Split an address into its host and port/path parts
+    bool parseAddress(const std::string &address, std::string &host, std::string &port) {
+        if (address.compare(0, 5, "unix:") == 0) {
+            host = "";
+            port = address.substr(5);
+            return true;
+        }
+        size_t colon = address.find_last_of(':');
+        if (colon == std::string::npos) {
+            host = "";
+            port = address;
+        } else {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        return false;
+    }
+
+    int createUnixSocket(const std::string &path, sockaddr_un &addr) {
+        if (path.size() >= sizeof(addr.sun_path))
+            throw NoriException("Socket: the path \"%s\" is too long", path);
+        memset(&addr, 0, sizeof(sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw NoriException("Socket: could not create a socket: %s", strerror(errno));
+        return fd;
+    }
+
+    template <typename Func> int forEachAddress(const std::string &host, const std::string &port,
+                                                bool passive, const Func &func) {
+        addrinfo hints, *result = nullptr;
+        memset(&hints, 0, sizeof(addrinfo));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (passive)
+            hints.ai_flags = AI_PASSIVE;
+
+        int rv = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+        if (rv != 0)
+            throw NoriException("Socket: could not resolve \"%s:%s\": %s", host, port, gai_strerror(rv));
+
+        int fd = -1;
+        for (addrinfo *ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0)
+                continue;
+            if (!func(fd, ai)) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        return fd;
+    }
+}
+
+std::unique_ptr<Socket> Socket::connect(const std::string &address) {
+    /* A peer that disappears must not kill the process via SIGPIPE */
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string host, port;
+    int fd;
+    if (parseAddress(address, host, port)) {
+        sockaddr_un addr;
+        fd = createUnixSocket(port, addr);
+        if (::connect(fd, (sockaddr *) &addr, sizeof(sockaddr_un)) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    } else {
+        fd = forEachAddress(host.empty() ? "localhost" : host, port, false,
+            [](int fd, addrinfo *ai) {
+                return ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+            });
+        if (fd >= 0) {
+            /* Result messages are large, but requests are tiny */
+            int flag = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
+        }
+    }
+    if (fd < 0)
+        throw NoriException("Socket: could not connect to \"%s\": %s", address, strerror(errno));
+    return std::unique_ptr<Socket>(new Socket(fd));
+}
+
+std::unique_ptr<Socket> Socket::listen(const std::string &address) {
+    /* A peer that disappears must not kill the process via SIGPIPE */
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string host, port;
+    int fd;
+    std::unique_ptr<Socket> socket(new Socket());
+    if (parseAddress(address, host, port)) {
+        sockaddr_un addr;
+        fd = createUnixSocket(port, addr);
+        ::unlink(port.c_str());
+        if (::bind(fd, (sockaddr *) &addr, sizeof(sockaddr_un)) != 0) {
+            ::close(fd);
+            fd = -1;
+        } else {
+            socket->m_unlinkPath = port;
+        }
+    } else {
+        fd = forEachAddress(host, port, true,
+            [](int fd, addrinfo *ai) {
+                int flag = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(int));
+                return ::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+            });
+    }
+    if (fd < 0 || ::listen(fd, 64) != 0)
+        throw NoriException("Socket: could not listen on \"%s\": %s", address, strerror(errno));
+    socket->m_fd = fd;
+    return socket;
+}
+
+std::unique_ptr<Socket> Socket::accept(int timeout) {
+    pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rv = poll(&pfd, 1, timeout);
+    if (rv == 0 || (rv < 0 && errno == EINTR))
+        return nullptr;
+    if (rv < 0)
+        throw NoriException("Socket::accept(): %s", strerror(errno));
+
+    int fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+            return nullptr;
+        throw NoriException("Socket::accept(): %s", strerror(errno));
+    }
+    return std::unique_ptr<Socket>(new Socket(fd));
+}
+
+bool Socket::sendAll(const void *data, size_t size) {
+    const char *ptr = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(m_fd, ptr, size, 0);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        ptr += sent;
+        size -= (size_t) sent;
+    }
+    return true;
+}
+
+bool Socket::recvAll(void *data, size_t size, int timeout) {
+    char *ptr = static_cast<char *>(data);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (size > 0) {
+        if (timeout >= 0) {
+            /* A peer whose host died never closes the connection, wait for it with a time limit */
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0)
+                return false;
+            pollfd pfd;
+            pfd.fd = m_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int rv = poll(&pfd, 1, (int) remaining);
+            if (rv < 0 && errno == EINTR)
+                continue;
+            if (rv <= 0)
+                return false;
+        }
+        ssize_t received = ::recv(m_fd, ptr, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        ptr += received;
+        size -= (size_t) received;
+    }
+    return true;
+}
+
+void Socket::shutdown() {
+    if (m_fd >= 0)
+        ::shutdown(m_fd, SHUT_RDWR);
+}
+
+void Socket::close() {
+    if (m_fd >= 0) {
+        ::shutdown(m_fd, SHUT_RDWR);
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    if (!m_unlinkPath.empty()) {
+        ::unlink(m_unlinkPath.c_str());
+        m_unlinkPath.clear();
+    }
+}
+
+#else
+
+std::unique_ptr<Socket> Socket::connect(const std::string &) {
+    throw NoriException("Socket: networking is not supported on Windows");
+}
+
+std::unique_ptr<Socket> Socket::listen(const std::string &) {
+    throw NoriException("Socket: networking is not supported on Windows");
+}
+
+std::unique_ptr<Socket> Socket::accept(int) { return nullptr; }
+bool Socket::sendAll(const void *, size_t) { return false; }
+bool Socket::recvAll(void *, size_t, int) { return false; }
+void Socket::shutdown() { }
+void Socket::close() { m_fd = -1; }
+
+#endif
+
+NORI_NAMESPACE_END
@@ -0,0 +1,62 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sparsegrid.h>
+
+NORI_NAMESPACE_BEGIN
+
+void SparseGrid::build(const DensityGrid &grid) {
+    m_size = grid.getSize();
+    m_bounds = grid.getBounds();
+    m_maxDensity = grid.getMaxDensity();
+    /* One tile of padding on each side */
+    for (int i = 0; i < 3; ++i)
+        m_tileCount[i] = ((m_size[i] + TileSize - 1) >> TileLog2) + 2;
+    m_tiles.assign((size_t) m_tileCount.x() * m_tileCount.y() * m_tileCount.z(), Tile { 0.f, ConstantTile });
+    m_bricks.clear();
+
+    std::vector<float> brick(TileVoxels);
+    for (int tz = 0; tz < m_tileCount.z(); ++tz) {
+        for (int ty = 0; ty < m_tileCount.y(); ++ty) {
+            for (int tx = 0; tx < m_tileCount.x(); ++tx) {
+                /* Gather the voxels of the tile. The padding and the voxels
+                   beyond the grid are empty */
+                bool constant = true;
+                for (int z = 0; z < TileSize; ++z) {
+                    for (int y = 0; y < TileSize; ++y) {
+                        for (int x = 0; x < TileSize; ++x) {
+                            Point3i p(((tx - 1) << TileLog2) + x, ((ty - 1) << TileLog2) + y, ((tz - 1) << TileLog2) + z);
+                            bool inside = (p.array() >= 0).all() && (p.array() < m_size.array()).all();
+                            float value = inside ? grid(p.x(), p.y(), p.z()) : 0.f;
+                            int index = (((z << TileLog2) + y) << TileLog2) + x;
+                            brick[index] = value;
+                            constant &= value == brick[0];
+                        }
+                    }
+                }
+
+                Tile &tile = m_tiles[((size_t) tz * m_tileCount.y() + ty) * m_tileCount.x() + tx];
+                if (constant) {
+                    tile.value = brick[0];
+                } else {
+                    tile.brick = (uint32_t) (m_bricks.size() / TileVoxels);
+                    m_bricks.insert(m_bricks.end(), brick.begin(), brick.end());
+                }
+            }
+        }
+    }
+    m_bricks.shrink_to_fit();
+}
+
+std::string SparseGrid::toString() const {
+    size_t denseBytes = (size_t) m_size.x() * m_size.y() * m_size.z() * sizeof(float);
+    return tfm::format(
+        "SparseGrid[size = %ix%ix%i, bricks = %i/%i, memory = %s (dense: %s)]",
+        m_size.x(), m_size.y(), m_size.z(), getBrickCount(), m_tiles.size(),
+        memString(getMemoryUsage()), memString(denseBytes));
+}
+
+NORI_NAMESPACE_END
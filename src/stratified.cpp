@@ -0,0 +1,132 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/lowdiscrepancy.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Stratified (jittered) sampler
+ *
+ * Every dimension of the sample space is split into \c sampleCount strata,
+ * and each pixel sample falls into a different one. 2D requests use a grid
+ * of <tt>nx * ny = sampleCount</tt> cells that is as square as possible.
+ * The assignment of samples to strata is a random permutation per pixel
+ * and dimension, which decorrelates the dimensions from each other.
+ *
+ * Unlike the \c pmj02 and \c sobol samplers, the stratification is only
+ * complete once all \c sampleCount samples have been taken. Samples beyond
+ * this count start a new, independently permuted round.
+ */
+class StratifiedSampler : public Sampler {
+public:
+    StratifiedSampler(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Jitter the samples within their strata? Otherwise, use the centers */
+        m_jitter = propList.getBoolean("jitter", true);
+
+        /* Seed for the permutations and jitter, changes the noise pattern */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+
+        configure();
+    }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<StratifiedSampler> cloned(new StratifiedSampler());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_jitter = m_jitter;
+        cloned->m_seed = m_seed;
+        cloned->m_resolution = m_resolution;
+        cloned->m_pixelHash = m_pixelHash;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void setSampleCount(size_t sampleCount) {
+        m_sampleCount = sampleCount;
+        configure();
+    }
+
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixelHash = hashCombine(
+            hashCombine((uint64_t) (uint32_t) pixel.x(), (uint64_t) (uint32_t) pixel.y()), m_seed);
+        m_sampleIndex = m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint64_t hash = dimensionHash();
+        uint32_t stratum = stratumIndex(hash);
+        return std::min((stratum + jitter(hash, 0)) / m_sampleCount, OneMinusEpsilon);
+    }
+
+    Point2f next2D() {
+        uint64_t hash = dimensionHash();
+        uint32_t stratum = stratumIndex(hash);
+        return Point2f(
+            std::min(((stratum % m_resolution.x()) + jitter(hash, 0)) / m_resolution.x(), OneMinusEpsilon),
+            std::min(((stratum / m_resolution.x()) + jitter(hash, 1)) / m_resolution.y(), OneMinusEpsilon)
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "StratifiedSampler[sampleCount=%i, resolution=%s, jitter=%s, seed=%i]",
+            m_sampleCount, m_resolution.toString(), m_jitter ? "true" : "false", m_seed);
+    }
+protected:
+    StratifiedSampler() { }
+
+    /// Choose the most square 2D grid with \c m_sampleCount cells
+    void configure() {
+        if (m_sampleCount == 0 || m_sampleCount > 0xFFFFFFFFu)
+            throw NoriException("StratifiedSampler: invalid sample count %i", m_sampleCount);
+        int nx = (int) std::sqrt((double) m_sampleCount);
+        while (m_sampleCount % nx != 0)
+            --nx;
+        m_resolution = Vector2i(nx, (int) (m_sampleCount / nx));
+    }
+
+    /// Hash of the current pixel, round of samples and (next) dimension
+    uint64_t dimensionHash() {
+        uint64_t round = m_sampleIndex / m_sampleCount;
+        return hashCombine(hashCombine(m_pixelHash, round), m_dimension++);
+    }
+
+    uint32_t stratumIndex(uint64_t hash) const {
+        uint32_t index = (uint32_t) (m_sampleIndex % m_sampleCount);
+        return permutationElement(index, (uint32_t) m_sampleCount, (uint32_t) hash);
+    }
+
+    float jitter(uint64_t hash, int i) const {
+        if (!m_jitter)
+            return 0.5f;
+        return hashToFloat(hashCombine(hash, ((uint64_t) m_sampleIndex << 1) | (uint64_t) i));
+    }
+
+private:
+    bool m_jitter = true;
+    uint32_t m_seed = 0;
+    Vector2i m_resolution;
+    uint64_t m_pixelHash = 0;
+    uint64_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(StratifiedSampler, "stratified");
+NORI_NAMESPACE_END
@@ -0,0 +1,51 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/densitygrid.h>
+#include <nori/timer.h>
+
+using namespace nori;
+
+/**
+ * Converts density grids from the text format to the binary format that
+ * \ref DensityGrid memory-maps. Binary grids can also be used as input,
+ * e.g. to change the bounds that are stored in the header.
+ */
+int main(int argc, char **argv) {
+    if (argc != 3 && argc != 9) {
+        cerr << "Syntax: " << argv[0] << " <input> <output> [minX minY minZ maxX maxY maxZ]" << endl
+             << "Converts a density grid to the binary format. The optional bounds" << endl
+             << "specify the extent of the grid in object space (default: unit cube)." << endl;
+        return -1;
+    }
+
+    try {
+        Timer timer;
+        DensityGrid grid;
+        grid.load(argv[1]);
+        cout << "Read " << grid.toString() << " (took " << timer.elapsedString() << ")" << endl;
+
+        if (argc == 9) {
+            Point3f min, max;
+            for (int i = 0; i < 3; ++i) {
+                min[i] = toFloat(argv[3 + i]);
+                max[i] = toFloat(argv[6 + i]);
+            }
+            BoundingBox3f bounds(min, max);
+            if (!bounds.isValid())
+                throw NoriException("Invalid bounds: %s", bounds.toString());
+            grid.setBounds(bounds);
+        }
+
+        timer.reset();
+        grid.save(argv[2]);
+        cout << "Wrote \"" << argv[2] << "\" (took " << timer.elapsedString() << ")" << endl;
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+#include <nori/emitter.h>
+#include <nori/mesh.h>
+#include <nori/medium.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Volumetric path tracer with next event estimation
+ *
+ * Paths are traced iteratively. Along every segment, the current medium
+ * samples a free-flight distance. At scattering events in media and at
+ * diffuse surfaces, an emitter is sampled and its contribution is
+ * attenuated by the transmittance estimate of \ref Medium::tr(). Light
+ * sampling and phase function (or BSDF) sampling are combined with
+ * multiple importance sampling. Paths are terminated by Russian roulette
+ * based on their throughput.
+ *
+ * Media with sampleable emission (e.g. a fire simulation in a
+ * \c griddensitymedium) are also sampled directly at every scattering event
+ * and diffuse surface, and combined with the emission found at collisions.
+ *
+ * The path starts in the scene's medium (if any), and the current medium
+ * changes whenever the path crosses a surface whose \ref MediumInterface
+ * is a transition between two media. Surfaces without a BSDF only bound
+ * media, and paths pass straight through them.
+ */
+class VolumetricPathIntegrator : public Integrator {
+public:
+    VolumetricPathIntegrator(const PropertyList &props) {
+        /* Maximum number of scattering events (-1: unlimited, terminated by Russian roulette) */
+        m_maxDepth = props.getInteger("maxDepth", -1);
+
+        /* Number of scattering events after which Russian roulette starts */
+        m_rrDepth = props.getInteger("rrDepth", 3);
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const {
+        Color3f L(0.f), throughput(1.f);
+        Ray3f ray(cameraRay);
+        const Medium *medium = scene->getMedium();
+
+        /* State of the previous vertex for multiple importance sampling */
+        bool specular = true;
+        float directionPdf = 0.f;
+        Point3f prevP(0.f);
+        Normal3f prevN(0.f);
+
+        for (int depth = 0; ; ++depth) {
+            Intersection its;
+            bool hit = scene->rayIntersect(ray, its);
+
+            /* Sample a scattering event along the segment */
+            Intersection mediumIts;
+            if (medium) {
+                Ray3f segment(ray.o, ray.d, ray.mint, hit ? its.t : std::numeric_limits<float>::infinity());
+                throughput *= medium->sample(segment, sampler, mediumIts, throughput);
+                if (throughput.isZero() || !throughput.isValid())
+                    break;
+            }
+
+            if (mediumIts.isMedium()) {
+                Point3f p = ray(mediumIts.t);
+                Vector3f wi = -ray.d;
+                const PhaseFunction *phase = medium->getPhase().get();
+
+                Color3f Le = medium->getEmittance(p, wi);
+                if (!Le.isZero()) {
+                    float weight = 1.f;
+                    if (!specular && medium->isEmitter()) {
+                        float dist2 = (p - prevP).squaredNorm();
+                        weight = misWeight(collisionPdf(medium, directionPdf, dist2),
+                                           scene->pdfMediumEmission(medium, p));
+                    }
+                    L += throughput * medium->sigmaA() * Le * weight;
+                }
+                throughput *= medium->sigmaS();
+
+                if (m_maxDepth >= 0 && depth >= m_maxDepth)
+                    break;
+
+                /* Next event estimation */
+                EmitterQueryRecord eRec;
+                float lightPdf;
+                float emitterSample = sampler->next1D();
+                const Emitter *emitter = scene->sampleEmitterPosition(p, Normal3f(0.f),
+                    emitterSample, sampler->next2D(), eRec, lightPdf);
+                if (emitter && lightPdf > 0 && eRec.normal.dot(p - eRec.point) > 0) {
+                    Vector3f d = (eRec.point - p).normalized();
+                    float phaseValue = phase->p(wi, d);
+                    Color3f tr = scene->evalTransmittance(p, eRec.point, medium, sampler);
+                    if (phaseValue > 0 && !tr.isZero())
+                        L += throughput * emitter->eval(eRec) * tr * phaseValue
+                             * misWeight(lightPdf, phaseValue) / lightPdf;
+                }
+
+                /* Next event estimation for emissive media. The sampled point may lie
+                   outside of the shapes that bound the medium and is then discarded */
+                Point3f q;
+                const Medium *emissiveMedium;
+                float emissionPdf;
+                Color3f emission = sampleMediumEmission(scene, sampler, q, emissiveMedium, emissionPdf);
+                if (!emission.isZero() && q != p) {
+                    Vector3f d = q - p;
+                    float dist2 = d.squaredNorm();
+                    d /= std::sqrt(dist2);
+                    float phaseValue = phase->p(wi, d);
+                    const Medium *endMedium = nullptr;
+                    Color3f tr = phaseValue > 0 ? scene->evalTransmittance(p, q, medium, sampler, &endMedium) : Color3f(0.f);
+                    if (!tr.isZero() && endMedium == emissiveMedium)
+                        L += throughput * emission * tr * phaseValue / (dist2 * emissionPdf)
+                             * misWeight(emissionPdf, collisionPdf(emissiveMedium, phaseValue, dist2));
+                }
+
+                /* Sample the phase function (its weight is one, and its density equals its value) */
+                Vector3f wo;
+                phase->sample(wi, wo, sampler->next2D());
+                directionPdf = phase->p(wi, wo);
+                specular = false;
+                prevP = p;
+                prevN = Normal3f(0.f);
+                ray = Ray3f(p, wo);
+            } else {
+                if (!hit) {
+                    if (scene->getEnvironment()) {
+                        float weight = specular ? 1.f : misWeight(directionPdf, scene->pdfEnvironment(ray));
+                        L += throughput * scene->evalEnvironment(ray) * weight;
+                    }
+                    break;
+                }
+
+                if (its.mesh->isEmitter()) {
+                    Color3f Le = its.mesh->getEmission(its, -ray.d);
+                    if (!Le.isZero()) {
+                        float weight = specular ? 1.f
+                            : misWeight(directionPdf, scene->pdfEmitterPosition(prevP, prevN, its));
+                        L += throughput * Le * weight;
+                    }
+                }
+
+                if (m_maxDepth >= 0 && depth >= m_maxDepth)
+                    break;
+
+                const BSDF *bsdf = its.mesh->getBSDF();
+                if (!bsdf) {
+                    /* Index-matched medium boundary: continue in the medium on the other side */
+                    medium = nextMedium(its, ray.d, medium);
+                    ray = Ray3f(its.p, ray.d);
+                    --depth;
+                    continue;
+                }
+
+                Vector3f wi = its.shFrame.toLocal(-ray.d);
+
+                /* Next event estimation */
+                if (bsdf->isDiffuse()) {
+                    EmitterQueryRecord eRec;
+                    float lightPdf;
+                    float emitterSample = sampler->next1D();
+                    const Emitter *emitter = scene->sampleEmitterPosition(its.p, its.shFrame.n,
+                        emitterSample, sampler->next2D(), eRec, lightPdf);
+                    if (emitter && lightPdf > 0 && eRec.normal.dot(its.p - eRec.point) > 0) {
+                        Vector3f d = (eRec.point - its.p).normalized();
+                        BSDFQueryRecord bRec(wi, its.shFrame.toLocal(d), ESolidAngle, sampler);
+                        Color3f f = bsdf->eval(bRec) * std::abs(its.shFrame.n.dot(d));
+                        Color3f tr = f.isZero() ? Color3f(0.f)
+                            : scene->evalTransmittance(its.p, eRec.point, nextMedium(its, d, medium), sampler);
+                        if (!tr.isZero())
+                            L += throughput * emitter->eval(eRec) * f * tr
+                                 * misWeight(lightPdf, bsdf->pdf(bRec)) / lightPdf;
+                    }
+
+                    /* Next event estimation for emissive media (see above) */
+                    Point3f q;
+                    const Medium *emissiveMedium;
+                    float emissionPdf;
+                    Color3f emission = sampleMediumEmission(scene, sampler, q, emissiveMedium, emissionPdf);
+                    if (!emission.isZero() && q != its.p) {
+                        Vector3f d = q - its.p;
+                        float dist2 = d.squaredNorm();
+                        d /= std::sqrt(dist2);
+                        BSDFQueryRecord bRec(wi, its.shFrame.toLocal(d), ESolidAngle, sampler);
+                        Color3f f = bsdf->eval(bRec) * std::abs(its.shFrame.n.dot(d));
+                        const Medium *endMedium = nullptr;
+                        Color3f tr = f.isZero() ? Color3f(0.f)
+                            : scene->evalTransmittance(its.p, q, nextMedium(its, d, medium), sampler, &endMedium);
+                        if (!tr.isZero() && endMedium == emissiveMedium)
+                            L += throughput * emission * f * tr / (dist2 * emissionPdf)
+                                 * misWeight(emissionPdf, collisionPdf(emissiveMedium, bsdf->pdf(bRec), dist2));
+                    }
+                }
+
+                /* Sample the BSDF */
+                BSDFQueryRecord bRec(wi, sampler);
+                Color3f weight = bsdf->sample(bRec, sampler->next2D());
+                if (weight.isZero() || !weight.isValid())
+                    break;
+                throughput *= weight;
+
+                Vector3f wo = its.shFrame.toWorld(bRec.wo);
+                specular = !bsdf->isDiffuse() || bRec.measure != ESolidAngle;
+                directionPdf = specular ? 0.f : bsdf->pdf(bRec);
+                prevP = its.p;
+                prevN = its.shFrame.n;
+                medium = nextMedium(its, wo, medium);
+                ray = Ray3f(its.p, wo);
+            }
+
+            /* Russian roulette */
+            if (depth >= m_rrDepth) {
+                float q = std::min(throughput.maxCoeff(), 0.95f);
+                if (sampler->next1D() >= q)
+                    break;
+                throughput /= q;
+            }
+        }
+
+        return L;
+    }
+
+    bool supportsMediumBoundaries() const { return true; }
+
+    std::string toString() const {
+        return tfm::format(
+            "VolumetricPathIntegrator[\n"
+            "  maxDepth = %i,\n"
+            "  rrDepth = %i\n"
+            "]",
+            m_maxDepth, m_rrDepth);
+    }
+
+private:
+    /// Return the medium on the side of a surface that the direction \c d points to
+    static const Medium *nextMedium(const Intersection &its, const Vector3f &d, const Medium *medium) {
+        if (!its.mediumInterface.isMediumTransition())
+            return medium;
+        return its.getMedium(d);
+    }
+
+    /// Sample a point of an emissive medium for next event estimation
+    static Color3f sampleMediumEmission(const Scene *scene, Sampler *sampler, Point3f &p,
+                                        const Medium *&medium, float &pdf) {
+        if (scene->getEmissiveMedia().empty()) {
+            pdf = 0.f;
+            return Color3f(0.f);
+        }
+        float u = sampler->next1D();
+        Point2f sample = sampler->next2D();
+        return scene->sampleMediumEmission(Point3f(u, sample.x(), sample.y()), p, medium, pdf);
+    }
+
+    /**
+     * Density (with respect to volume) of reaching a point of an emissive
+     * medium by sampling a direction and a free-flight distance. The
+     * transmittance and the spatial variation of the extinction are ignored.
+     * This only affects the variance, since both strategies use the same
+     * weights. The density still goes up near the previous vertex, where
+     * emission sampling would have unbounded variance.
+     */
+    static float collisionPdf(const Medium *medium, float directionPdf, float distSquared) {
+        return directionPdf * (medium->sigmaA() + medium->sigmaS()).maxCoeff() / distSquared;
+    }
+
+    /// Balance heuristic
+    static float misWeight(float pdf, float otherPdf) {
+        return pdf + otherPdf > 0 ? pdf / (pdf + otherPdf) : 0.f;
+    }
+
+    int m_maxDepth;
+    int m_rrDepth;
+};
+
+NORI_REGISTER_CLASS(VolumetricPathIntegrator, "volpath");
+NORI_NAMESPACE_END
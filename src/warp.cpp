@@ -7,6 +7,7 @@
 #include <nori/warp.h>
 #include <nori/vector.h>
 #include <nori/frame.h>
+#include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
 
@@ -117,4 +118,44 @@ float Warp::phaseHG(float cosTheta, float g) {
     return M_1_PI * 0.25f * (1 - g * g) / (denom * std::sqrt(denom));
 }
 
+Vector3f Warp::squareToSphericalTriangle(const Point2f &sample, const Vector3f &a,
+                                         const Vector3f &b, const Vector3f &c) {
+    /* Normals of the great circles through the edges */
+    Vector3f nab = a.cross(b), nbc = b.cross(c), nca = c.cross(a);
+    if (nab.squaredNorm() == 0 || nbc.squaredNorm() == 0 || nca.squaredNorm() == 0)
+        return a;
+    nab.normalize(); nbc.normalize(); nca.normalize();
+
+    /* Interior angles at the vertices */
+    auto angleBetween = [](const Vector3f &v1, const Vector3f &v2) {
+        return std::acos(clamp(v1.dot(v2), -1.f, 1.f));
+    };
+    float alpha = angleBetween(nab, -nca);
+    float beta = angleBetween(nbc, -nab);
+    float gamma = angleBetween(nca, -nbc);
+
+    /* Choose the area of the sub-triangle (a, b, c') and find c' on the edge (a, c) */
+    float areaPi = alpha + beta + gamma;
+    float subAreaPi = M_PI + sample.x() * (areaPi - M_PI);
+    float cosAlpha = std::cos(alpha), sinAlpha = std::sin(alpha);
+    float sinPhi = std::sin(subAreaPi) * cosAlpha - std::cos(subAreaPi) * sinAlpha;
+    float cosPhi = std::cos(subAreaPi) * cosAlpha + std::sin(subAreaPi) * sinAlpha;
+    float k1 = cosPhi + cosAlpha;
+    float k2 = sinPhi - sinAlpha * a.dot(b);
+    float cosBp = (k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / ((k2 * sinPhi + k1 * cosPhi) * sinAlpha);
+    cosBp = clamp(cosBp, -1.f, 1.f);
+    float sinBp = std::sqrt(std::max(0.f, 1 - cosBp * cosBp));
+    Vector3f cp = cosBp * a + sinBp * (c - c.dot(a) * a).normalized();
+
+    /* Uniformly choose a point on the arc between b and c' */
+    float cosTheta = 1 - sample.y() * (1 - cp.dot(b));
+    float sinTheta = std::sqrt(std::max(0.f, 1 - cosTheta * cosTheta));
+    return (cosTheta * b + sinTheta * (cp - cp.dot(b) * b).normalized()).normalized();
+}
+
+float Warp::sphericalTriangleArea(const Vector3f &a, const Vector3f &b, const Vector3f &c) {
+    /* Van Oosterom and Strackee, "The Solid Angle of a Plane Triangle" (1983) */
+    return std::abs(2 * std::atan2(a.dot(b.cross(c)), 1 + a.dot(b) + a.dot(c) + b.dot(c)));
+}
+
 NORI_NAMESPACE_END
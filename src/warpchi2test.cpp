@@ -0,0 +1,247 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/object.h>
+#include <nori/warp.h>
+#include <nori/phasefunction.h>
+#include <pcg32.h>
+#include <hypothesis.h>
+#include <Eigen/Geometry>
+#include <functional>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Chi-square test of a warping function on the sphere against the
+ * density that it claims to produce
+ *
+ * Works like \c chi2test, but tests warping functions that are not part of
+ * a BSDF. Each test draws a random configuration of the warp (see the
+ * \c warp property), bins the warped samples into a contingency table
+ * over \f$(\cos\theta, \phi)\f$ and compares it to the integral of the
+ * density over each bin.
+ *
+ * The density is integrated with the midpoint rule on a fine grid within
+ * each bin. Unlike adaptive quadrature, this also converges for densities
+ * with discontinuities, such as the indicator of a spherical triangle.
+ */
+class WarpChiSquareTest : public NoriObject {
+public:
+    WarpChiSquareTest(const PropertyList &propList) {
+        /* Warping function that should be tested. Supported values:
+           "sphericalTriangle": Warp::squareToSphericalTriangle()
+           "henyeyGreenstein":  HenyeyGreenstein::sample() */
+        m_warp = propList.getString("warp");
+        if (m_warp != "sphericalTriangle" && m_warp != "henyeyGreenstein")
+            throw NoriException("WarpChiSquareTest: unknown warp \"%s\"", m_warp);
+
+        /* List of asymmetry parameters of the Henyey-Greenstein phase function */
+        std::vector<std::string> values = tokenize(propList.getString("g", "0"));
+        for (auto value : values)
+            m_g.push_back(toFloat(value));
+
+        /* The null hypothesis will be rejected when the associated
+           p-value is below the significance level specified here. */
+        m_significanceLevel = propList.getFloat("significanceLevel", 0.01f);
+
+        /* Number of cells along the latitudinal axis. The azimuthal
+           resolution is twice this value. */
+        m_cosThetaResolution = propList.getInteger("resolution", 10);
+        m_phiResolution = 2 * m_cosThetaResolution;
+
+        /* Cells with a lower expected frequency are merged (see chi2test) */
+        m_minExpFrequency = propList.getInteger("minExpFrequency", 5);
+
+        /* Number of samples that should be taken (-1: automatic) */
+        m_sampleCount = propList.getInteger("sampleCount", -1);
+        if (m_sampleCount < 0) // ~5K samples per bin
+            m_sampleCount = m_cosThetaResolution * m_phiResolution * 5000;
+
+        /* Number of random configurations of the warp that are tested
+           (for every value of 'g' in the case of "henyeyGreenstein") */
+        m_testCount = propList.getInteger("testCount", 5);
+
+        /* Midpoint rule cells per bin and axis for integrating the density */
+        m_integrationResolution = propList.getInteger("integrationResolution", 64);
+    }
+
+    /// Execute the chi-square test
+    void activate() {
+        int passed = 0, res = m_cosThetaResolution * m_phiResolution;
+        int total = m_warp == "henyeyGreenstein" ? m_testCount * (int) m_g.size() : m_testCount;
+        std::unique_ptr<double[]> obsFrequencies(new double[res]);
+        std::unique_ptr<double[]> expFrequencies(new double[res]);
+        pcg32 random;
+
+        for (int l = 0; l < total; ++l) {
+            std::function<Vector3f(const Point2f &)> warp;
+            std::function<float(const Vector3f &)> pdf;
+            std::string description = m_warp == "henyeyGreenstein"
+                ? createHenyeyGreenstein(random, m_g[l / m_testCount], warp, pdf)
+                : createSphericalTriangle(random, warp, pdf);
+
+            cout << "------------------------------------------------------" << endl;
+            cout << "Testing: " << description << endl;
+
+            cout << "Accumulating " << m_sampleCount << " samples into a " << m_cosThetaResolution
+                 << "x" << m_phiResolution << " contingency table .. ";
+            cout.flush();
+            memset(obsFrequencies.get(), 0, res * sizeof(double));
+            for (int i = 0; i < m_sampleCount; ++i) {
+                Vector3f d = warp(Point2f(random.nextFloat(), random.nextFloat()));
+                obsFrequencies[bin(d)] += 1;
+            }
+            cout << "done." << endl;
+
+            cout << "Integrating expected frequencies .. ";
+            cout.flush();
+            int n = m_integrationResolution;
+            double cellArea = (2.0 / (m_cosThetaResolution * n)) * (2 * M_PI / (m_phiResolution * n));
+            double *ptr = expFrequencies.get();
+            for (int i = 0; i < m_cosThetaResolution; ++i) {
+                for (int j = 0; j < m_phiResolution; ++j) {
+                    double integral = 0;
+                    for (int y = 0; y < n; ++y) {
+                        double cosTheta = -1.0 + (i + (y + 0.5) / n) * 2.0 / m_cosThetaResolution;
+                        double sinTheta = std::sqrt(std::max(0.0, 1 - cosTheta * cosTheta));
+                        for (int x = 0; x < n; ++x) {
+                            double phi = (j + (x + 0.5) / n) * 2 * M_PI / m_phiResolution;
+                            Vector3f d((float) (sinTheta * std::cos(phi)),
+                                       (float) (sinTheta * std::sin(phi)),
+                                       (float) cosTheta);
+                            integral += pdf(d);
+                        }
+                    }
+                    *ptr++ = integral * cellArea * m_sampleCount;
+                }
+            }
+            cout << "done." << endl;
+
+            std::pair<bool, std::string> result =
+                hypothesis::chi2_test(res, obsFrequencies.get(), expFrequencies.get(),
+                    m_sampleCount, m_minExpFrequency, m_significanceLevel, total);
+            if (result.first)
+                ++passed;
+            cout << result.second << endl;
+        }
+
+        cout << "Passed " << passed << "/" << total << " tests." << endl;
+        if (passed < total)
+            throw std::runtime_error("Some tests failed :(");
+    }
+
+    std::string toString() const {
+        return tfm::format("WarpChiSquareTest[\n"
+            "  warp = \"%s\",\n"
+            "  g = \"%s\",\n"
+            "  thetaResolution = %i,\n"
+            "  phiResolution = %i,\n"
+            "  minExpFrequency = %i,\n"
+            "  sampleCount = %i,\n"
+            "  testCount = %i,\n"
+            "  integrationResolution = %i,\n"
+            "  significanceLevel = %f\n"
+            "]",
+            m_warp,
+            gString(),
+            m_cosThetaResolution,
+            m_phiResolution,
+            m_minExpFrequency,
+            m_sampleCount,
+            m_testCount,
+            m_integrationResolution,
+            m_significanceLevel
+        );
+    }
+
+    EClassType getClassType() const { return ETest; }
+private:
+    /// Index of the contingency table cell that contains a direction
+    int bin(const Vector3f &d) const {
+        int cosThetaBin = std::min(std::max(0, (int) std::floor((d.z() * 0.5f + 0.5f)
+                * m_cosThetaResolution)), m_cosThetaResolution - 1);
+
+        float scaledPhi = std::atan2(d.y(), d.x()) * INV_TWOPI;
+        if (scaledPhi < 0)
+            scaledPhi += 1;
+
+        int phiBin = std::min(std::max(0,
+            (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution - 1);
+        return cosThetaBin * m_phiResolution + phiBin;
+    }
+
+    /**
+     * Random spherical triangle that is neither tiny (which would leave
+     * only a few cells with samples) nor close to a hemisphere
+     */
+    static std::string createSphericalTriangle(pcg32 &random,
+            std::function<Vector3f(const Point2f &)> &warp,
+            std::function<float(const Vector3f &)> &pdf) {
+        Vector3f a, b, c;
+        float area;
+        do {
+            a = Warp::squareToUniformSphere(Point2f(random.nextFloat(), random.nextFloat()));
+            b = Warp::squareToUniformSphere(Point2f(random.nextFloat(), random.nextFloat()));
+            c = Warp::squareToUniformSphere(Point2f(random.nextFloat(), random.nextFloat()));
+            area = Warp::sphericalTriangleArea(a, b, c);
+        } while (area < 0.2f || area > 3.f);
+
+        warp = [a, b, c](const Point2f &sample) {
+            return Warp::squareToSphericalTriangle(sample, a, b, c);
+        };
+
+        /* Uniform within the triangle, i.e. on the inner side of all three edges */
+        float orientation = a.dot(b.cross(c)) > 0 ? 1.f : -1.f;
+        Vector3f nab = a.cross(b) * orientation, nbc = b.cross(c) * orientation,
+                 nca = c.cross(a) * orientation;
+        pdf = [nab, nbc, nca, area](const Vector3f &d) {
+            return (d.dot(nab) >= 0 && d.dot(nbc) >= 0 && d.dot(nca) >= 0) ? 1.f / area : 0.f;
+        };
+
+        return tfm::format("sphericalTriangle[a = %s, b = %s, c = %s, area = %f]",
+            a.toString(), b.toString(), c.toString(), area);
+    }
+
+    /// Henyey-Greenstein phase function with a random incident direction
+    static std::string createHenyeyGreenstein(pcg32 &random, float g,
+            std::function<Vector3f(const Point2f &)> &warp,
+            std::function<float(const Vector3f &)> &pdf) {
+        Vector3f wi = Warp::squareToUniformSphere(Point2f(random.nextFloat(), random.nextFloat()));
+        auto phase = std::make_shared<HenyeyGreenstein>(g);
+
+        warp = [phase, wi](const Point2f &sample) {
+            Vector3f wo;
+            phase->sample(wi, wo, sample);
+            return wo;
+        };
+        pdf = [phase, wi](const Vector3f &wo) {
+            return phase->p(wi, wo);
+        };
+
+        return tfm::format("henyeyGreenstein[g = %f, wi = %s]", g, wi.toString());
+    }
+
+    std::string gString() const {
+        std::string result;
+        for (size_t i = 0; i < m_g.size(); ++i)
+            result += (i > 0 ? ", " : "") + tfm::format("%f", m_g[i]);
+        return result;
+    }
+
+    std::string m_warp;
+    std::vector<float> m_g;
+    int m_cosThetaResolution;
+    int m_phiResolution;
+    int m_minExpFrequency;
+    int m_sampleCount;
+    int m_testCount;
+    int m_integrationResolution;
+    float m_significanceLevel;
+};
+
+NORI_REGISTER_CLASS(WarpChiSquareTest, "warpchi2test");
+NORI_NAMESPACE_END
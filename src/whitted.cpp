@@ -21,7 +21,7 @@ public:
         /* Find the surface that is visible in the requested direction */
         Intersection its;
         if (!scene->rayIntersect(ray, its))
-            return Color3f(0.0f);
+            return scene->evalEnvironment(ray);
 
         Color3f l_e = its.mesh->getEmission(its, -ray.d);
         Color3f l_dir(0);
@@ -38,16 +38,16 @@ public:
             return l_e + l_dir;
         }
 
-        auto lights = scene->getEmitters();
+        float lightPdf;
         EmitterQueryRecord sampleLightRecord;
-        Emitter *pLight = lights[std::rand() % lights.size()]->getEmitter();
+        const Emitter *pLight = scene->sampleEmitter(sampler->next1D(), lightPdf);
         auto l_i = pLight->sample(its.p, sampleLightRecord, sampler->next2D());
         auto wi = (sampleLightRecord.point - its.p).normalized();
         if (!scene->illuminatedEachOther(its.p, sampleLightRecord.point)) {
             return l_e;
         }
         BSDFQueryRecord bsdf_record(its.shFrame.toLocal(wi), its.shFrame.toLocal(-ray.d), ESolidAngle, sampler);
-        l_dir = l_i * its.mesh->getBSDF()->eval(bsdf_record) * std::max(0.f, its.shFrame.n.dot(wi)) * lights.size();
+        l_dir = l_i * its.mesh->getBSDF()->eval(bsdf_record) * std::max(0.f, its.shFrame.n.dot(wi)) / lightPdf;
 
         return l_e + l_dir;
     }